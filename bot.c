@@ -0,0 +1,398 @@
+/*!
+    @file bot.c
+    @brief Эвристические боты
+
+    Бот перебирает все повороты и положения текущей фигуры, которые достижимы сдвигами
+    от точки появления, и выбирает положение с лучшей оценкой поля.
+*/
+
+#include "tetris.h"
+#include <string.h>
+
+/*!
+    Набор политик ботов. Оценка поля - взвешенная сумма его признаков
+*/
+const BotPolicy BOT_POLICIES[BOT_POLICIES_COUNT] = {
+    {"balanced", -0.510066, 0.760666, -0.356630, -0.184483},
+    {"holes", -0.300000, 0.500000, -0.900000, -0.150000},
+    {"flat", -0.400000, 0.600000, -0.300000, -0.600000},
+    {"greedy", -0.100000, 1.000000, -0.100000, -0.050000},
+    {"tall", 0.000000, 0.300000, -0.500000, -0.100000}
+};
+
+
+/*!
+    @brief Ищет политику бота по имени
+
+    @param name Имя политики
+
+    @return const BotPolicy* - политика или NULL, если политики с таким именем нет
+
+     bot.c find_bot_policy
+*/
+
+const BotPolicy *find_bot_policy(const char *name){
+    for(int i = 0; i < BOT_POLICIES_COUNT; i++){
+        if(strcmp(BOT_POLICIES[i].name, name) == 0){
+            return &BOT_POLICIES[i];
+        }
+    }
+    return NULL;
+}
+
+
+/*!
+    @brief Считает высоту столбца и количество пустых клеток под его верхней занятой клеткой
+
+    @param table Игровое поле
+    @param column Номер столбца
+    @param[out] height Высота столбца
+    @param[out] holes Количество пустых клеток под верхней занятой клеткой
+
+     bot.c column_features
+*/
+
+static void column_features(Board *table, int column, int *height, int *holes){
+    int i = 0;
+    while(i < MAX_HEIGHT && !table->cells[i][column]){
+        i++;
+    }
+    *height = MAX_HEIGHT - i;
+    *holes = 0;
+    for(; i < MAX_HEIGHT; i++){
+        if(!table->cells[i][column]){
+            (*holes)++;
+        }
+    }
+}
+
+
+/*!
+    @brief Оценивает поле по признакам его столбцов
+
+    @param policy Политика бота
+    @param heights Высоты столбцов
+    @param holes Количество пустых клеток в каждом столбце
+    @param lines Количество линий, убранных последней фигурой
+
+    @return double - оценка поля, чем больше, тем лучше
+
+     bot.c evaluate_columns
+*/
+
+static double evaluate_columns(const BotPolicy *policy, int heights[MAX_BOARD_WIDTH], int holes[MAX_BOARD_WIDTH], int lines){
+    int aggregate_height = heights[0];
+    int total_holes = holes[0];
+    int bumpiness = 0;
+    for(int j = 1; j < board_width; j++){
+        aggregate_height += heights[j];
+        total_holes += holes[j];
+        bumpiness += abs(heights[j] - heights[j - 1]);
+    }
+    return policy->height_weight * aggregate_height + policy->lines_weight * lines + policy->holes_weight * total_holes + policy->bumpiness_weight * bumpiness;
+}
+
+
+/*!
+    @brief Оценивает поле по признакам политики
+
+    @param policy Политика бота
+    @param table Игровое поле
+    @param lines Количество линий, убранных последней фигурой
+
+    @return double - оценка поля, чем больше, тем лучше
+
+     bot.c evaluate_table
+*/
+
+double evaluate_table(const BotPolicy *policy, Board *table, int lines){
+    int heights[MAX_BOARD_WIDTH];
+    int holes[MAX_BOARD_WIDTH];
+    for(int j = 0; j < board_width; j++){
+        column_features(table, j, &heights[j], &holes[j]);
+    }
+    return evaluate_columns(policy, heights, holes, lines);
+}
+
+
+/*!
+    @brief Копирует игровое поле
+
+    @param destination Поле, в которое копируются клетки
+    @param source Исходное поле
+
+     bot.c copy_table
+*/
+
+void copy_table(Board *destination, Board *source){
+    *destination = *source;
+}
+
+
+/*!
+    @brief Проверяет, заполнена ли хотя бы одна строка, которую занимает фигура
+
+    @param shape Фигура, уже записанная в поле
+    @param table Игровое поле
+
+    @return int - 1 если есть заполненная строка, иначе 0
+
+     bot.c fills_line
+*/
+
+static int fills_line(Shape shape, Board *table){
+    for(int i = 0; i < shape.width && shape.y + i < MAX_HEIGHT; i++){
+        int j = 0;
+        while(j < board_width && table->cells[shape.y + i][j]){
+            j++;
+        }
+        if(j == board_width){
+            return 1;
+        }
+    }
+    return 0;
+}
+
+
+/*!
+    @brief Находит строку, в которой упавшая фигура коснётся поля
+
+    Если фигура целиком выше верхних клеток своих столбцов, она падает на них.
+    Иначе возвращается текущая строка фигуры и падение досчитывается по клеткам.
+    Нижние клетки столбцов фигуры берутся из подготовленного профиля поворота.
+    @param shape Фигура
+    @param heights Высоты столбцов поля
+
+    @return int - строка фигуры после падения или текущая строка
+
+     bot.c landing_row
+*/
+
+static int landing_row(Shape shape, int heights[MAX_BOARD_WIDTH]){
+    const PieceOrientation *orientation = &piece_orientations[shape.color - 1][shape.rotation];
+    int landing = MAX_HEIGHT;
+    for(int j = orientation->leftmost; j <= orientation->rightmost; j++){
+        int bottom = orientation->bottom[j];
+        if(bottom < 0){
+            continue;
+        }
+        int top = MAX_HEIGHT - heights[shape.x + j];
+        if(shape.y + bottom >= top){
+            return shape.y;
+        }
+        if(top - bottom - 1 < landing){
+            landing = top - bottom - 1;
+        }
+    }
+    return landing;
+}
+
+
+/*!
+    @brief Запоминает клетки поля, которые займёт фигура
+
+    @param shape Фигура
+    @param table Игровое поле
+    @param[out] saved Клетки поля под фигурой
+
+     bot.c save_shape_cells
+*/
+
+static void save_shape_cells(Shape shape, Board *table, char saved[MAX_SHAPE_CELLS]){
+    const PieceOrientation *orientation = &piece_orientations[shape.color - 1][shape.rotation];
+    for(int k = 0; k < orientation->count; k++){
+        saved[k] = table->cells[shape.y + orientation->cell_rows[k]][shape.x + orientation->cell_columns[k]];
+    }
+}
+
+
+/*!
+    @brief Возвращает клетки поля, запомненные save_shape_cells
+
+    @param shape Фигура
+    @param table Игровое поле
+    @param saved Клетки поля под фигурой
+
+     bot.c restore_shape_cells
+*/
+
+static void restore_shape_cells(Shape shape, Board *table, char saved[MAX_SHAPE_CELLS]){
+    const PieceOrientation *orientation = &piece_orientations[shape.color - 1][shape.rotation];
+    for(int k = 0; k < orientation->count; k++){
+        table->cells[shape.y + orientation->cell_rows[k]][shape.x + orientation->cell_columns[k]] = saved[k];
+    }
+}
+
+
+/*!
+    @brief Оценивает поле после постановки фигуры
+
+    Фигура примеряется прямо на поле и затем убирается, хеш поля восстанавливается.
+    Копия поля нужна только если фигура убирает линии.
+    @param policy Политика бота
+    @param dropped Фигура в положении после падения
+    @param table Игровое поле
+    @param scratch Поле для подсчёта убранных линий
+    @param base_heights Высоты столбцов поля до постановки фигуры
+    @param base_holes Количество пустых клеток в столбцах до постановки фигуры
+
+    @return double - оценка поля
+
+     bot.c evaluate_placement
+*/
+
+static double evaluate_placement(const BotPolicy *policy, Shape dropped, Board *table, Board *scratch, int base_heights[MAX_BOARD_WIDTH], int base_holes[MAX_BOARD_WIDTH]){
+    char saved[MAX_SHAPE_CELLS];
+    unsigned long long saved_hash = table->hash;
+    save_shape_cells(dropped, table, saved);
+    write_shape_to_table(dropped, table);
+
+    double value;
+    if(fills_line(dropped, table)){
+        copy_table(scratch, table);
+        int score = 0, level = 1, speed = 1;
+        int lines = check_for_full_line(scratch, &score, &level, &speed);
+        value = evaluate_table(policy, scratch, lines);
+    }else{
+        int heights[MAX_BOARD_WIDTH];
+        int holes[MAX_BOARD_WIDTH];
+        memcpy(heights, base_heights, sizeof(heights));
+        memcpy(holes, base_holes, sizeof(holes));
+        for(int j = 0; j < dropped.width; j++){
+            if(dropped.x + j >= 0 && dropped.x + j < board_width){
+                column_features(table, dropped.x + j, &heights[dropped.x + j], &holes[dropped.x + j]);
+            }
+        }
+        value = evaluate_columns(policy, heights, holes, 0);
+    }
+
+    restore_shape_cells(dropped, table, saved);
+    table->hash = saved_hash;
+    return value;
+}
+
+
+/*!
+    @brief Считает ключ политики для таблицы транспозиций по её имени (FNV-1a)
+
+    @param policy Политика бота
+
+    @return unsigned long long - ключ политики
+
+     bot.c policy_hash
+*/
+
+static unsigned long long policy_hash(const BotPolicy *policy){
+    unsigned long long hash = 0xcbf29ce484222325ULL;
+    for(const char *c = policy->name; *c; c++){
+        hash = (hash ^ (unsigned char)*c) * 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+
+/*!
+    @brief Выбирает ход бота для текущей фигуры
+
+    @param policy Политика бота
+    @param shape Текущая фигура
+    @param table Игровое поле. Во время поиска фигура временно записывается в него
+    @param scratch Поле для подсчёта убранных линий, его содержимое перезаписывается
+    @param cache Таблица транспозиций с оценками позиций или NULL. Позиция, уже оценённая
+    этой политикой, стоит одного поиска в таблице
+
+    @return BotMove - количество поворотов и сдвиг от крайнего левого положения.
+    Если фигуру некуда поставить, rotations равно -1
+
+     bot.c choose_bot_move
+*/
+
+BotMove choose_bot_move(const BotPolicy *policy, Shape shape, Board *table, Board *scratch, TranspositionTable *cache){
+    BotMove best = {-1, 0, 0};
+    //Оценки разных политик не должны совпадать по ключу
+    unsigned long long policy_key = cache ? policy_hash(policy) : 0;
+    unsigned tried = 0;
+
+    //Фигура меняет только свои столбцы, остальные считаются один раз на ход
+    int base_heights[MAX_BOARD_WIDTH];
+    int base_holes[MAX_BOARD_WIDTH];
+    for(int j = 0; j < board_width; j++){
+        column_features(table, j, &base_heights[j], &base_holes[j]);
+    }
+
+    for(int rotations = 0; rotations < 4; rotations++){
+        Shape rotated = shape;
+        for(int i = 0; i < rotations; i++){
+            rotate_shape(&rotated, table);
+        }
+
+        //Симметричные фигуры повторяют уже проверенные повороты, одинаковые повороты имеют общий canonical
+        int canonical = piece_orientations[rotated.color - 1][rotated.rotation].canonical;
+        if(tried & (1u << canonical)){
+            continue;
+        }
+        tried |= 1u << canonical;
+
+        while(!check_if_touches_left_border(rotated, table)){
+            move_shape(&rotated, 'l', table);
+        }
+
+        for(int shift = 0; ; shift++){
+            Shape dropped = rotated;
+            dropped.y = landing_row(rotated, base_heights);
+            while(!check_if_touches_another_shape(dropped, table)){
+                dropped.y++;
+            }
+
+            double value;
+            unsigned long long key = 0, cached;
+            if(cache){
+                key = position_hash(table, dropped) ^ policy_key;
+            }
+            if(cache && transposition_probe(cache, key, &cached)){
+                memcpy(&value, &cached, sizeof(value));
+            }else{
+                value = evaluate_placement(policy, dropped, table, scratch, base_heights, base_holes);
+                if(cache){
+                    memcpy(&cached, &value, sizeof(value));
+                    transposition_store(cache, key, 0, cached);
+                }
+            }
+
+            if(best.rotations < 0 || value > best.score){
+                best.rotations = rotations;
+                best.shift = shift;
+                best.score = value;
+            }
+
+            if(check_if_touches_right_border(rotated, table)){
+                break;
+            }
+            move_shape(&rotated, 'r', table);
+        }
+    }
+    return best;
+}
+
+
+/*!
+    @brief Выполняет ход бота тем же способом, которым он был найден
+
+    @param move Ход бота
+    @param shape Указатель на текущую фигуру
+    @param table Игровое поле
+
+     bot.c apply_bot_move
+*/
+
+void apply_bot_move(BotMove move, Shape *shape, Board *table){
+    for(int i = 0; i < move.rotations; i++){
+        rotate_shape(shape, table);
+    }
+    while(!check_if_touches_left_border(*shape, table)){
+        move_shape(shape, 'l', table);
+    }
+    for(int i = 0; i < move.shift; i++){
+        move_shape(shape, 'r', table);
+    }
+}
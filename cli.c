@@ -5,6 +5,11 @@
 
 #include "tetris.h"
 #include <locale.h>
+#include <unistd.h>
+#include <string.h>
+
+static int versus_mode = 0; ///<1 если пункт меню запускает режим против
+static const BotPolicy *versus_opponent = NULL; ///<Бот правого игрока или NULL для второго человека
 
 /*!
     \brief Функция печатает новую фигуру в окно игрового статута
@@ -17,9 +22,12 @@
  
 void print_new_shape(WINDOW *game_status_window, Shape *shape){
     
+    //Фигура любой ширины помещается в квадрат MAX_SHAPE_WIDTH x MAX_SHAPE_WIDTH над SPEED и выравнивается по его центру
+    int left = 4 + MAX_SHAPE_WIDTH - shape->width;
+    int top = 2 + (MAX_SHAPE_WIDTH - shape->width) / 2;
     for(int i = 0; i < shape->width; i++){
         for(int j = 0; j < shape->width; j++){
-            mvwaddstr(game_status_window, i + shape->width, 2* j + shape->width + 3, shape->shape_array[i][j] ? "\u2588\u2588" : "  ");
+            mvwaddstr(game_status_window, top + i, left + 2 * j, shape->shape_array[i][j] ? "\u2588\u2588" : "  ");
         }
     }
 
@@ -46,22 +54,22 @@ void print_new_shape(WINDOW *game_status_window, Shape *shape){
 
  
 
-int print_table(WINDOW *gamefield, Shape current_shape, char** table, WINDOW *score, WINDOW *game_status_window, int score_counter, Shape next_shape, int pause_flag, char **buffer, int speed, int level) {
+int print_table(WINDOW *gamefield, Shape current_shape, Board *table, WINDOW *score, WINDOW *game_status_window, int score_counter, Shape next_shape, int pause_flag, Board *buffer, int speed, int level) {
 
     for (int i = 0; i < MAX_HEIGHT; i++){
         
-        for (int j = 0; j < MAX_WIDTH; j++){
+        for (int j = 0; j < board_width; j++){
             wattron(gamefield, COLOR_PAIR(8));
-            if(table[i][j] + buffer[i][j]){
+            if(table->cells[i][j] + buffer->cells[i][j]){
                 wattron(gamefield, COLOR_PAIR(6));
             }
-            if(buffer[i][j]){
+            if(buffer->cells[i][j]){
 
                 wattron(gamefield, COLOR_PAIR(4));
 
 
             }
-            mvwaddstr(gamefield, i + 1, 2*j + 1, table[i][j] + buffer[i][j] ? "  ":"  ");
+            mvwaddstr(gamefield, i + 1, 2*j + 1, table->cells[i][j] + buffer->cells[i][j] ? "  ":"  ");
 
             wattroff(gamefield, A_COLOR);
         }
@@ -90,6 +98,37 @@ int print_table(WINDOW *gamefield, Shape current_shape, char** table, WINDOW *sc
     
 }
  
+/*!
+    @brief Размещает окна игры по центру терминала
+
+    Окно очков находится над игровым полем, окно статуса справа от него.
+    Вызывается при старте игры и при получении KEY_RESIZE.
+    @param gamefield Окно игрового поля
+    @param game_status_window Окно статуса игры
+    @param score Окно очков
+
+     cli.c layout_game
+*/
+
+void layout_game(WINDOW *gamefield, WINDOW *game_status_window, WINDOW *score){
+    int field_width = (board_width + 1)*2;
+    int top = (LINES - (MAX_HEIGHT + 2) - 3) / 2;
+    int left = (COLS - field_width - 20) / 2;
+    if(top < 0){
+        top = 0;
+    }
+    if(left < 0){
+        left = 0;
+    }
+
+    mvwin(score, top, left);
+    mvwin(gamefield, top + 3, left);
+    mvwin(game_status_window, top + 3, left + field_width);
+    clear();
+    refresh();
+}
+
+
 /*!
     @brief Создаёт окна для игры, запускает игру
 
@@ -109,7 +148,6 @@ void game_cli() {
     init_pair(4, COLOR_CYAN, COLOR_CYAN);
     init_pair(6, COLOR_YELLOW, COLOR_YELLOW);
     init_pair(8, COLOR_BLACK, COLOR_BLACK);
-    nodelay(stdscr, true);
     curs_set(0);
     keypad(stdscr, true);
     cbreak();
@@ -117,7 +155,8 @@ void game_cli() {
 
     WINDOW *score = newwin(3, 50, 7, 20);
     WINDOW *game_status_window = newwin(MAX_HEIGHT + 2, 20, 10, 50);
-    WINDOW *gamefield = newwin(MAX_HEIGHT + 2, (MAX_WIDTH + 1)*2, 10, 20);
+    WINDOW *gamefield = newwin(MAX_HEIGHT + 2, (board_width + 1)*2, 10, 20);
+    layout_game(gamefield, game_status_window, score);
 
     refresh();
     main_loop(game_status_window, gamefield, score);
@@ -129,6 +168,24 @@ void game_cli() {
 }
  
 
+/*!
+    @brief Запускает режим против в терминале, окна создаёт versus_loop
+
+     cli.c versus_cli
+*/
+
+void versus_cli() {
+    clear();
+    curs_set(0);
+    keypad(stdscr, true);
+    cbreak();
+    noecho();
+
+    versus_loop(versus_opponent);
+    clear();
+}
+
+
 /*!
     @brief Обрабатывает выбор пользователя в меню
 
@@ -140,7 +197,11 @@ void game_cli() {
 int handle_menu_option(int choice) {
     if(choice == 0){
         clear();
-        game_cli();
+        if(versus_mode){
+            versus_cli();
+        }else{
+            game_cli();
+        }
     }
 
     if(choice == 1){
@@ -152,86 +213,191 @@ int handle_menu_option(int choice) {
 }
  
 
-int main() {
+/*!
+    @brief Размещает окна меню по центру терминала
+
+    Вызывается при старте и при получении KEY_RESIZE, в остальное время окна не перемещаются.
+    @param title_win Окно заголовка
+    @param menu_win Окно пунктов меню
+    @param controls_win Окно с подсказкой по управлению
+
+     cli.c layout_menu
+*/
+
+void layout_menu(WINDOW *title_win, WINDOW *menu_win, WINDOW *controls_win){
+    mvwin(title_win, LINES/2 - 3, COLS/2 - 15);
+    mvwin(menu_win, LINES/2, COLS/2 - 15);
+    mvwin(controls_win, LINES/2 + 5, COLS/2 - 29);
+}
+
+
+/*!
+    @brief Отрисовывает меню
+
+    @param title_win Окно заголовка
+    @param menu_win Окно пунктов меню
+    @param controls_win Окно с подсказкой по управлению
+    @param choice Выбранный пункт меню
+
+     cli.c draw_menu
+*/
+
+void draw_menu(WINDOW *title_win, WINDOW *menu_win, WINDOW *controls_win, int choice){
+    werase(title_win);
+    werase(menu_win);
+    werase(controls_win);
+
+    mvwprintw(title_win, 1, 3, "BRICK GAME 1.0");
+    box(title_win, 0, 0);
+
+    mvwprintw(menu_win, 1, 5, "Start Game");
+    mvwprintw(menu_win, 3, 8, "Exit");
+    box(menu_win, 0, 0);
+    if(choice == 0){
+        mvwaddch(menu_win, 1, 3, '>');
+        mvwaddch(menu_win, 1, 16, '<');
+    }
+
+    if(choice == 1){
+        mvwaddch(menu_win, 3, 6, '>');
+        mvwaddch(menu_win, 3, 13, '<');
+    }
+
+    mvwprintw(controls_win, 1, 10, "Arrow keys - move, R - rotate");
+    mvwprintw(controls_win, 3, 6, "Space - drop, P - pause, Q - exit");
+    box(controls_win, 0, 0);
+
+    wnoutrefresh(stdscr);
+    wnoutrefresh(title_win);
+    wnoutrefresh(menu_win);
+    wnoutrefresh(controls_win);
+    doupdate();
+}
+
+
+/*!
+    @brief Точка входа
+
+    Параметры командной строки:
+    -t FILE дописывать события телеметрии в CSV файл FILE
+    -s записать итоги сессии в telemetry_summary.txt рядом с highscore.txt
+    -r DIR сохранять записи игр в папку DIR для replay_analyzer
+    -d MS задержка перед автоповтором стрелок
+    -a MS период автоповтора стрелок, 0 - сдвиг до упора
+    -w WIDTH ширина игрового поля
+    -f FILE набор фигур из файла, см. pieces.c
+    -v OPPONENT режим против: human - второй человек за той же клавиатурой, иначе имя политики бота
+*/
+
+int main(int argc, char **argv) {
+    int das = INPUT_DAS;
+    int arr = INPUT_ARR;
+    int width = MAX_WIDTH;
+    const char *pieces_path = NULL;
+    const char *telemetry_path = NULL;
+    const char *summary_path = NULL;
+    int opt;
+    while((opt = getopt(argc, argv, "st:r:d:a:w:f:v:")) != -1){
+        switch(opt){
+            case 's':
+            summary_path = "telemetry_summary.txt";
+            break;
+            case 't':
+            telemetry_path = optarg;
+            break;
+            case 'r':
+            replay_configure(optarg);
+            break;
+            case 'd':
+            das = atoi(optarg);
+            break;
+            case 'a':
+            arr = atoi(optarg);
+            break;
+            case 'w':
+            width = atoi(optarg);
+            break;
+            case 'f':
+            pieces_path = optarg;
+            break;
+            case 'v':
+            versus_mode = 1;
+            versus_opponent = strcmp(optarg, "human") == 0 ? NULL : find_bot_policy(optarg);
+            if(strcmp(optarg, "human") != 0 && !versus_opponent){
+                fprintf(stderr, "unknown opponent: %s\n", optarg);
+                return 1;
+            }
+            break;
+            default:
+            fprintf(stderr, "usage: %s [-s] [-t telemetry_csv] [-r replay_dir] [-d das_ms] [-a arr_ms] [-w width] [-f pieces_file] [-v human|policy]\n", argv[0]);
+            return 1;
+        }
+    }
+    telemetry_configure(telemetry_path, summary_path);
+    input_configure(das, arr);
+    if(set_board_width(width) != 0){
+        fprintf(stderr, "bad width: %d, must be %d..%d\n", width, MIN_BOARD_WIDTH, MAX_BOARD_WIDTH);
+        return 1;
+    }
+    if(pieces_path && load_piece_set(pieces_path) != 0){
+        return 1;
+    }
+    engine_init();
+
     setlocale(LC_CTYPE, "en_US.UTF-8");
     initscr();
     noecho();
     cbreak();
     curs_set(0);
-    nodelay(stdscr, true);
     keypad(stdscr, true);
 
     WINDOW *title_win = newwin(3, 21, LINES/2 - 3, COLS/2 - 15);
     WINDOW *menu_win = newwin(5, 21, LINES/2, COLS/2 - 15);
-    WINDOW *controls_win = newwin(5, 50, LINES/2 + 3, COLS/2 - 15);
+    WINDOW *controls_win = newwin(5, 50, LINES/2 + 5, COLS/2 - 29);
     refresh();
-    
 
     int choice = 0;
-    int old_lines = LINES;
-    int old_cols = COLS;
+    int redraw = 1;
 
     while(true){
-        
-        refresh();
-        
-        mvwin(title_win, LINES/2 - 3, COLS/2 - 15);
-        mvwprintw(title_win, 1, 3, "BRICK GAME 1.0");
-        box(title_win, 0, 0);
-        wrefresh(title_win);
-
-        mvwin(menu_win, LINES/2, COLS/2 - 15);
-        mvwprintw(menu_win, 1, 5, "Start Game");
-        mvwprintw(menu_win, 3, 8, "Exit");
-        box(menu_win, 0, 0);
-
-        mvwin(controls_win, LINES/2 + 5, COLS/2 - 29);
-        mvwprintw(controls_win, 1, 10, "Arrow keys - move, R - rotate");
-        mvwprintw(controls_win, 3, 14, "P - pause, Q - exit");
-        box(controls_win, 0, 0);
-        wrefresh(controls_win);
-
-        if(old_cols != COLS || old_lines != LINES){
-            touchwin(stdscr);
-            old_cols = COLS;
-            old_lines = LINES;
+
+        if(redraw){
+            draw_menu(title_win, menu_win, controls_win, choice);
+            redraw = 0;
         }
-        
-        
+
+        //Меню ничего не делает без ввода, поэтому ждём нажатия клавиши или KEY_RESIZE от SIGWINCH
+        timeout(-1);
         switch(getch()){
+            case KEY_RESIZE:
+            clear();
+            layout_menu(title_win, menu_win, controls_win);
+            redraw = 1;
+            break;
             case KEY_UP:
             choice--;
             if(choice < 0){
                 choice = 1;
             }
+            redraw = 1;
             break;
             case KEY_DOWN:
             choice++;
             if (choice > 1){
                 choice = 0;
             }
+            redraw = 1;
             break;
             case '\n':
             handle_menu_option(choice);
+            //Пока шла игра, размер терминала мог измениться
+            clear();
+            layout_menu(title_win, menu_win, controls_win);
+            redraw = 1;
             break;
         }
-        if(choice == 0){
-            mvwaddch(menu_win, 1, 3, '>');
-            mvwaddch(menu_win, 1, 16, '<');
-        }
-
-        if(choice == 1){
-            mvwaddch(menu_win, 3, 6, '>');
-            mvwaddch(menu_win, 3, 13, '<');
-        }
-        wrefresh(menu_win);
-        werase(menu_win);
-        werase(title_win);
     }
 
     endwin();
     
 }
-
-
-
@@ -0,0 +1,52 @@
+/*!
+    @file observer_example.c
+    @brief Пример наблюдателя: печатает поле идущей игры
+
+    Использование: observer_example <pid игры> [кадров]
+*/
+
+#include "tetris.h"
+#include <unistd.h>
+
+int main(int argc, char **argv){
+    if(argc < 2){
+        fprintf(stderr, "usage: %s game_pid [frames]\n", argv[0]);
+        return 1;
+    }
+    char path[64];
+    snprintf(path, sizeof(path), SHARED_STATE_PATH_FORMAT, atoi(argv[1]));
+    int frames = argc > 2 ? atoi(argv[2]) : 1;
+
+    const SharedState *shared = shared_state_open(path);
+    if(!shared){
+        fprintf(stderr, "no game state at %s\n", path);
+        return 1;
+    }
+
+    SharedState snapshot;
+    for(int frame = 0; frame < frames; frame++){
+        if(shared_state_read(shared, &snapshot) != 0){
+            fprintf(stderr, "game stopped in the middle of a frame\n");
+            shared_state_close(shared);
+            return 1;
+        }
+        Shape shape = snapshot.current_shape;
+        printf("frame %lu score %d level %d speed %d%s\n", snapshot.frame, snapshot.score, snapshot.level, snapshot.speed, snapshot.paused ? " paused" : "");
+        for(int i = 0; i < snapshot.height; i++){
+            for(int j = 0; j < snapshot.width; j++){
+                int in_shape = i >= shape.y && i < shape.y + shape.width && j >= shape.x && j < shape.x + shape.width && shape.shape_array[i - shape.y][j - shape.x];
+                putchar(in_shape ? '@' : snapshot.board[i][j] ? '#' : '.');
+            }
+            putchar('\n');
+        }
+        if(snapshot.finished){
+            break;
+        }
+        if(frame + 1 < frames){
+            usleep(200000);
+        }
+    }
+
+    shared_state_close(shared);
+    return 0;
+}
@@ -0,0 +1,490 @@
+/*!
+    @file perft.c
+    @brief Подсчёт достижимых положений фигур (perft)
+
+    Из заданного поля и последовательности фигур перебирает все положения, в которых фигура
+    может остановиться, двигаясь по правилам move_shape и rotate_shape, и считает различные
+    итоговые поля до заданной глубины. Известные ответы для фиксированных позиций служат
+    проверкой для любого более быстрого генератора ходов, а узлы в секунду - мерой скорости движка.
+    Поля различаются по их хешам Зобриста, которые движок обновляет при постановке фигуры и удалении
+    линий. С ключом -H уже посчитанные поддеревья берутся из таблицы транспозиций по хешу поля и глубине,
+    а после каждого подсчёта печатается её статистика.
+
+    Использование: perft [-w ширина] [-H биты_таблицы] [-f файл_фигур] [-b файл_поля] [-d глубина] фигуры
+                   perft [-H биты_таблицы] -t
+    Фигуры задаются буквами набора, по умолчанию OZTSJLI, файл поля - строками из '.' и '#', выровненными по дну.
+    Известные ответы посчитаны для встроенного набора и поля ширины MAX_WIDTH, поэтому -t всегда использует их
+    и не сочетается с -f.
+*/
+
+#include "tetris.h"
+#include <string.h>
+#include <unistd.h>
+
+#define PERFT_HASH_SET_SIZE 4096 ///<Размер множества итоговых полей одного узла, степень двойки
+#define PERFT_MAX_DEPTH 16 ///<Максимальная глубина перебора
+
+/*!
+    Структура, определяющая положение фигуры при переборе
+*/
+typedef struct perft_state{
+    int orientation; ///<Номер поворота фигуры
+    int x; ///<Координата фигуры по x
+    int y; ///<Координата фигуры по y
+}PerftState;
+
+/*!
+    Структура, определяющая рабочую память одного уровня перебора
+*/
+typedef struct perft_level{
+    Board *table; ///<Поле после постановки фигуры
+    unsigned char *visited; ///<Посещённые положения фигуры
+    PerftState *queue; ///<Очередь обхода положений
+    PerftState *placements; ///<Положения, в которых фигура касается поля
+    unsigned long long *hashes; ///<Множество итоговых полей
+}PerftLevel;
+
+/*!
+    Структура, определяющая позицию с известным ответом
+*/
+typedef struct perft_case{
+    const char *name; ///<Название позиции
+    const char *board; ///<Строки поля сверху вниз, разделённые '/'
+    const char *pieces; ///<Последовательность фигур
+    int depth; ///<Глубина
+    long long expected; ///<Известное количество итоговых полей
+}PerftCase;
+
+#define VISITED_WIDTH (board_width + 2 * MAX_SHAPE_WIDTH)
+#define VISITED_SIZE (4 * MAX_HEIGHT * VISITED_WIDTH)
+
+static const PerftCase PERFT_CASES[] = {
+    {"empty O", "", "O", 1, 13},
+    {"empty T", "", "T", 1, 50},
+    {"empty I", "", "I", 1, 25},
+    {"empty TO", "", "TO", 2, 650},
+    {"empty SZI", "", "SZI", 3, 16720},
+    {"well L", "#############./#############./#############./##.##########.", "LI", 2, 1278},
+    {"overhang J", "......###...../..........#.../####.######.##", "JT", 2, 2750}
+};
+
+static long long perft_nodes; ///<Количество различных полей на всех уровнях, кроме взятых из таблицы
+static TranspositionTable *perft_cache; ///<Количество итоговых полей уже посчитанных поддеревьев или NULL
+static Shape shape_orientations[MAX_SHAPES][4]; ///<Повороты фигур в точке появления
+
+
+/*!
+    @brief Готовит повороты всех фигур в точке появления
+
+    Повороты получаются через rotate_shape на пустом поле, поэтому совпадают с поворотами в игре.
+
+     perft.c init_orientations
+*/
+
+static void init_orientations(){
+    Board *empty = create_table();
+    for(int type = 0; type < shapes_count; type++){
+        Shape shape = SHAPES[type];
+        for(int k = 0; k < 4; k++){
+            shape.x = 0;
+            shape.y = 0;
+            shape_orientations[type][k] = shape;
+            shape_orientations[type][k].x = (board_width - shape.width) / 2;
+            rotate_shape(&shape, empty);
+        }
+    }
+    clear_table_memory(empty);
+}
+
+
+/*!
+    @brief Добавляет хеш поля в множество уровня
+
+    @param hashes Множество хешей
+    @param hash Хеш поля
+
+    @return int - 1 если такого поля ещё не было, иначе 0
+
+     perft.c insert_hash
+*/
+
+static int insert_hash(unsigned long long *hashes, unsigned long long hash){
+    unsigned index = (unsigned)hash & (PERFT_HASH_SET_SIZE - 1);
+    while(hashes[index]){
+        if(hashes[index] == hash){
+            return 0;
+        }
+        index = (index + 1) & (PERFT_HASH_SET_SIZE - 1);
+    }
+    hashes[index] = hash;
+    return 1;
+}
+
+
+/*!
+    @brief Собирает фигуру в заданном положении
+
+    @param orientations Повороты фигуры
+    @param state Положение
+
+    @return Shape - фигура
+
+     perft.c state_shape
+*/
+
+static Shape state_shape(Shape orientations[4], PerftState state){
+    Shape shape = orientations[state.orientation];
+    shape.x = state.x;
+    shape.y = state.y;
+    return shape;
+}
+
+
+/*!
+    @brief Отмечает положение посещённым и ставит его в очередь
+
+    @param level Рабочая память уровня
+    @param tail Указатель на конец очереди
+    @param state Положение
+
+     perft.c visit
+*/
+
+static void visit(PerftLevel *level, int *tail, PerftState state){
+    int index = (state.orientation * MAX_HEIGHT + state.y) * VISITED_WIDTH + state.x + MAX_SHAPE_WIDTH;
+    if(!level->visited[index]){
+        level->visited[index] = 1;
+        level->queue[(*tail)++] = state;
+    }
+}
+
+
+/*!
+    @brief Находит все положения, в которых фигура касается поля
+
+    Обходит положения фигуры в ширину, применяя move_shape и rotate_shape.
+    @param level Рабочая память уровня
+    @param table Игровое поле
+    @param orientations Повороты фигуры, orientations[0] - положение появления
+
+    @return int - количество найденных положений
+
+     perft.c find_placements
+*/
+
+static int find_placements(PerftLevel *level, Board *table, Shape orientations[4]){
+    memset(level->visited, 0, VISITED_SIZE);
+    int head = 0, tail = 0, count = 0;
+
+    PerftState spawn = {0, orientations[0].x, orientations[0].y};
+    if(!check_nonvalid_rotation(state_shape(orientations, spawn), table)){
+        return 0;
+    }
+    visit(level, &tail, spawn);
+
+    while(head < tail){
+        PerftState state = level->queue[head++];
+        Shape shape = state_shape(orientations, state);
+        if(check_if_touches_another_shape(shape, table)){
+            level->placements[count++] = state;
+        }
+
+        static const char directions[] = {'l', 'r', 'd'};
+        for(int i = 0; i < 3; i++){
+            Shape moved = shape;
+            move_shape(&moved, directions[i], table);
+            visit(level, &tail, (PerftState){state.orientation, moved.x, moved.y});
+        }
+
+        //Одинаковые повороты симметричной фигуры - одно положение
+        Shape rotated = shape;
+        rotate_shape(&rotated, table);
+        visit(level, &tail, (PerftState){piece_orientations[rotated.color - 1][rotated.rotation].canonical, rotated.x, rotated.y});
+    }
+    return count;
+}
+
+
+/*!
+    @brief Считает различные итоговые поля на заданной глубине
+
+    @param levels Рабочая память уровней
+    @param table Игровое поле
+    @param pieces Последовательность индексов фигур
+    @param depth Оставшаяся глубина
+
+    @return long long - количество итоговых полей
+
+     perft.c perft
+*/
+
+static long long perft(PerftLevel *levels, Board *table, const int *pieces, int depth){
+    if(depth == 0){
+        return 1;
+    }
+
+    //Фигуры на каждой глубине одни и те же, поэтому поддерево определяется полем и глубиной
+    unsigned long long key = table->hash ^ (unsigned long long)depth * 0x9e3779b97f4a7c15ULL;
+    unsigned long long cached;
+    if(perft_cache && transposition_probe(perft_cache, key, &cached)){
+        return (long long)cached;
+    }
+
+    PerftLevel *level = &levels[depth - 1];
+    Shape *orientations = shape_orientations[pieces[0]];
+
+    int count = find_placements(level, table, orientations);
+    memset(level->hashes, 0, PERFT_HASH_SET_SIZE * sizeof(unsigned long long));
+
+    long long total = 0;
+    for(int i = 0; i < count; i++){
+        copy_table(level->table, table);
+        write_shape_to_table(state_shape(orientations, level->placements[i]), level->table);
+        int score = 0, game_level = 1, speed = 1;
+        check_for_full_line(level->table, &score, &game_level, &speed);
+        unsigned long long hash = level->table->hash;
+        if(!insert_hash(level->hashes, hash ? hash : 1)){
+            continue;
+        }
+
+        perft_nodes++;
+        if(depth == 1){
+            total++;
+        }else if(!check_for_lose(level->table)){
+            total += perft(levels, level->table, pieces + 1, depth - 1);
+        }
+    }
+    if(perft_cache){
+        transposition_store(perft_cache, key, depth, (unsigned long long)total);
+    }
+    return total;
+}
+
+
+/*!
+    @brief Разбирает поле из строк, разделённых '/' или переводом строки
+
+    Строки выравниваются по дну поля, '#' - занятая клетка, '.' - пустая.
+    @param text Строки поля
+    @param table Игровое поле
+
+    @return int - 0 если поле разобрано, иначе -1
+
+     perft.c parse_board
+*/
+
+static int parse_board(const char *text, Board *table){
+    int rows = 0;
+    for(const char *p = text; *p; p += strcspn(p, "/\n") + (p[strcspn(p, "/\n")] != 0)){
+        if((int)strcspn(p, "/\n") != board_width || rows == MAX_HEIGHT){
+            return -1;
+        }
+        rows++;
+    }
+
+    int i = MAX_HEIGHT - rows;
+    for(const char *p = text; *p; p += board_width + (p[board_width] != 0), i++){
+        for(int j = 0; j < board_width; j++){
+            if(p[j] != '#' && p[j] != '.'){
+                return -1;
+            }
+            table->cells[i][j] = (p[j] == '#');
+        }
+    }
+    table_rehash(table);
+    return 0;
+}
+
+
+/*!
+    @brief Переводит буквы фигур в индексы массива SHAPES
+
+    @param letters Буквы фигур
+    @param[out] pieces Индексы фигур
+
+    @return int - количество фигур или -1, если встретилась неизвестная буква
+
+     perft.c parse_pieces
+*/
+
+static int parse_pieces(const char *letters, int *pieces){
+    int count = 0;
+    for(const char *p = letters; *p && count < PERFT_MAX_DEPTH; p++){
+        const char *letter = strchr(shape_letters, *p);
+        if(!letter || !*p){
+            return -1;
+        }
+        pieces[count++] = letter - shape_letters;
+    }
+    return count;
+}
+
+
+/*!
+    @brief Запускает перебор и печатает количество полей и скорость
+
+    @param levels Рабочая память уровней
+    @param table Игровое поле
+    @param pieces Индексы фигур
+    @param depth Глубина
+
+    @return long long - количество итоговых полей
+
+     perft.c run_perft
+*/
+
+static long long run_perft(PerftLevel *levels, Board *table, const int *pieces, int depth){
+    struct timeval start_time, end_time;
+    perft_nodes = 0;
+    if(perft_cache){
+        transposition_clear(perft_cache);
+    }
+    gettimeofday(&start_time, NULL);
+    long long result = perft(levels, table, pieces, depth);
+    gettimeofday(&end_time, NULL);
+
+    double seconds = (end_time.tv_sec - start_time.tv_sec) + (end_time.tv_usec - start_time.tv_usec) / 1000000.0;
+    printf("perft(%d) = %lld, %lld nodes in %.3f s, %.0f nodes/sec\n", depth, result, perft_nodes, seconds, seconds > 0 ? perft_nodes / seconds : 0.0);
+    if(perft_cache){
+        transposition_report(perft_cache, stdout);
+    }
+    return result;
+}
+
+
+static void print_usage(const char *name){
+    fprintf(stderr, "usage: %s [-w width] [-H table_bits] [-f pieces_file] [-b board_file] [-d depth] pieces\n       %s [-H table_bits] -t\npieces are letters of %s\n", name, name, shape_letters);
+}
+
+
+int main(int argc, char **argv){
+    const char *board_path = NULL;
+    const char *pieces_path = NULL;
+    int depth = 0;
+    int run_cases = 0;
+    int width = MAX_WIDTH;
+    int table_bits = 0;
+
+    int opt;
+    while((opt = getopt(argc, argv, "w:H:f:b:d:t")) != -1){
+        switch(opt){
+            case 'w':
+            width = atoi(optarg);
+            break;
+            case 'f':
+            pieces_path = optarg;
+            break;
+            case 'H':
+            table_bits = atoi(optarg);
+            break;
+            case 'b':
+            board_path = optarg;
+            break;
+            case 'd':
+            depth = atoi(optarg);
+            break;
+            case 't':
+            run_cases = 1;
+            break;
+            default:
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+    if(run_cases && pieces_path){
+        fprintf(stderr, "-t checks the built-in pieces and cannot be combined with -f\n");
+        return 1;
+    }
+    if(set_board_width(run_cases ? MAX_WIDTH : width) != 0){
+        fprintf(stderr, "bad width: %d, must be %d..%d\n", width, MIN_BOARD_WIDTH, MAX_BOARD_WIDTH);
+        return 1;
+    }
+    if(pieces_path && load_piece_set(pieces_path) != 0){
+        return 1;
+    }
+    engine_init();
+    if(table_bits < 0 || table_bits > 30){
+        print_usage(argv[0]);
+        return 1;
+    }
+    perft_cache = table_bits ? transposition_create(table_bits) : NULL;
+
+    PerftLevel levels[PERFT_MAX_DEPTH];
+    for(int i = 0; i < PERFT_MAX_DEPTH; i++){
+        levels[i].table = create_table();
+        levels[i].visited = (unsigned char*)malloc(VISITED_SIZE);
+        levels[i].queue = (PerftState*)malloc(VISITED_SIZE * sizeof(PerftState));
+        levels[i].placements = (PerftState*)malloc(VISITED_SIZE * sizeof(PerftState));
+        levels[i].hashes = (unsigned long long*)malloc(PERFT_HASH_SET_SIZE * sizeof(unsigned long long));
+    }
+    Board *table = create_table();
+    int pieces[PERFT_MAX_DEPTH];
+    init_orientations();
+    int failed = 0;
+
+    if(run_cases){
+        for(size_t c = 0; c < sizeof(PERFT_CASES) / sizeof(PERFT_CASES[0]); c++){
+            const PerftCase *test = &PERFT_CASES[c];
+            for(int i = 0; i < MAX_HEIGHT; i++){
+                memset(table->cells[i], 0, board_width);
+            }
+            if(parse_board(test->board, table) != 0 || parse_pieces(test->pieces, pieces) != test->depth){
+                printf("FAILED: %s is malformed\n", test->name);
+                failed = 1;
+                continue;
+            }
+            printf("%-12s ", test->name);
+            long long result = run_perft(levels, table, pieces, test->depth);
+            if(result != test->expected){
+                printf("FAILED: %s expected %lld, got %lld\n", test->name, test->expected, result);
+                failed = 1;
+            }
+        }
+    }else{
+        if(optind >= argc){
+            print_usage(argv[0]);
+            return 1;
+        }
+        int count = parse_pieces(argv[optind], pieces);
+        if(count <= 0){
+            fprintf(stderr, "bad piece sequence: %s\n", argv[optind]);
+            return 1;
+        }
+        if(depth <= 0 || depth > count){
+            depth = count;
+        }
+
+        if(board_path){
+            FILE *board_file = fopen(board_path, "r");
+            if(!board_file){
+                perror(board_path);
+                return 1;
+            }
+            char text[(MAX_BOARD_WIDTH + 2) * MAX_HEIGHT + 1];
+            size_t length = fread(text, 1, sizeof(text) - 1, board_file);
+            text[length] = 0;
+            fclose(board_file);
+            while(length && (text[length - 1] == '\n' || text[length - 1] == '\r')){
+                text[--length] = 0;
+            }
+            if(parse_board(text, table) != 0){
+                fprintf(stderr, "bad board: %s must have at most %d rows of %d '.' or '#'\n", board_path, MAX_HEIGHT, board_width);
+                return 1;
+            }
+        }
+        run_perft(levels, table, pieces, depth);
+    }
+
+    clear_table_memory(table);
+    for(int i = 0; i < PERFT_MAX_DEPTH; i++){
+        clear_table_memory(levels[i].table);
+        free(levels[i].visited);
+        free(levels[i].queue);
+        free(levels[i].placements);
+        free(levels[i].hashes);
+    }
+    if(perft_cache){
+        transposition_destroy(perft_cache);
+    }
+    return failed;
+}
@@ -0,0 +1,334 @@
+/*!
+    @file pieces.c
+    @brief Наборы фигур и их подготовленные повороты
+
+    По умолчанию в игре семь встроенных фигур. Набор можно заменить фигурами из
+    текстового файла, например пентамино. Файл состоит из строк:
+    ; комментарий,
+    буква фигуры - начало новой фигуры,
+    N строк по N символов '.' или '#' - клетки фигуры, N не больше MAX_SHAPE_WIDTH.
+    Пустые строки пропускаются.
+
+    Все четыре поворота каждой фигуры считаются один раз, в engine_init.
+    Горячие функции движка берут готовый поворот из piece_orientations и не
+    поворачивают массив клеток, поэтому их стоимость зависит только от количества клеток.
+*/
+
+#include "tetris.h"
+#include <ctype.h>
+#include <string.h>
+
+char shape_letters[MAX_SHAPES + 1] = "OZTSJLI"; ///<Буквы фигур в порядке массива SHAPES
+int shapes_count = BUILTIN_SHAPES_COUNT; ///<Количество фигур текущего набора
+PieceOrientation piece_orientations[MAX_SHAPES][4]; ///<Повороты фигур набора
+
+
+/*!
+    @brief Поворачивает клетки фигуры на 90 градусов по часовой стрелке внутри квадрата её ширины
+
+    @param cells Клетки фигуры
+    @param width Ширина фигуры
+
+     pieces.c rotate_cells
+*/
+
+static void rotate_cells(char cells[MAX_SHAPE_WIDTH][MAX_SHAPE_WIDTH], int width){
+    for(int i = 0; i < width; i++){
+        for(int j = i + 1; j < width; j++){
+            char temp = cells[i][j];
+            cells[i][j] = cells[j][i];
+            cells[j][i] = temp;
+        }
+    }
+
+    //reverse each row
+    for(int i = 0; i < width; i++){
+        int start = 0, end = width - 1;
+        while(start < end){
+            char temp = cells[i][start];
+            cells[i][start] = cells[i][end];
+            cells[i][end] = temp;
+            start++;
+            end--;
+        }
+    }
+}
+
+
+/*!
+    @brief Заполняет маски, список клеток и профили поворота по его клеткам
+
+    @param orientation Поворот, клетки которого уже заполнены
+    @param width Ширина фигуры
+
+     pieces.c compile_orientation
+*/
+
+static void compile_orientation(PieceOrientation *orientation, int width){
+    orientation->mask = 0;
+    orientation->count = 0;
+    orientation->top = MAX_SHAPE_WIDTH;
+    orientation->lowest = -1;
+    orientation->leftmost = MAX_SHAPE_WIDTH;
+    orientation->rightmost = -1;
+    memset(orientation->rows, 0, sizeof(orientation->rows));
+    memset(orientation->bottom, -1, sizeof(orientation->bottom));
+    memset(orientation->left, -1, sizeof(orientation->left));
+    memset(orientation->right, -1, sizeof(orientation->right));
+
+    for(int i = 0; i < width; i++){
+        for(int j = 0; j < width; j++){
+            if(!orientation->cells[i][j]){
+                continue;
+            }
+            orientation->mask |= 1u << (i * MAX_SHAPE_WIDTH + j);
+            orientation->rows[i] |= 1u << j;
+            orientation->cell_rows[orientation->count] = i;
+            orientation->cell_columns[orientation->count] = j;
+            orientation->count++;
+
+            orientation->bottom[j] = i;
+            if(orientation->left[i] < 0){
+                orientation->left[i] = j;
+            }
+            orientation->right[i] = j;
+            if(i < orientation->top){
+                orientation->top = i;
+            }
+            orientation->lowest = i;
+            if(j < orientation->leftmost){
+                orientation->leftmost = j;
+            }
+            if(j > orientation->rightmost){
+                orientation->rightmost = j;
+            }
+        }
+    }
+
+    orientation->solid_rows = 1;
+    for(int i = 0; i < width; i++){
+        if(orientation->left[i] >= 0 &&
+           orientation->rows[i] != (1u << (orientation->right[i] + 1)) - (1u << orientation->left[i])){
+            orientation->solid_rows = 0;
+        }
+    }
+}
+
+
+/*!
+    @brief Готовит повороты всех фигур текущего набора
+
+    Повороты получаются тем же поворотом квадрата, что и в игре, поэтому фигура
+    встроенного набора ведёт себя так же, как до подготовки поворотов.
+
+     pieces.c compile_piece_set
+*/
+
+void compile_piece_set(){
+    for(int type = 0; type < shapes_count; type++){
+        int width = SHAPES[type].width;
+        char cells[MAX_SHAPE_WIDTH][MAX_SHAPE_WIDTH];
+        memcpy(cells, SHAPES[type].shape_array, sizeof(cells));
+
+        for(int rotation = 0; rotation < 4; rotation++){
+            PieceOrientation *orientation = &piece_orientations[type][rotation];
+            memcpy(orientation->cells, cells, sizeof(cells));
+            compile_orientation(orientation, width);
+
+            orientation->canonical = rotation;
+            for(int k = 0; k < rotation; k++){
+                if(piece_orientations[type][k].mask == orientation->mask){
+                    orientation->canonical = k;
+                    break;
+                }
+            }
+            rotate_cells(cells, width);
+        }
+    }
+}
+
+
+/*!
+    @brief Считает хеш текущего набора фигур (FNV-1a) по буквам, ширинам и клеткам фигур
+
+    Записи игр хранят этот хеш, чтобы запись не симулировалась с другим набором.
+
+    @return unsigned - хеш набора
+
+     pieces.c piece_set_hash
+*/
+
+unsigned piece_set_hash(){
+    unsigned hash = 2166136261u;
+    for(int type = 0; type < shapes_count; type++){
+        hash = (hash ^ (unsigned char)shape_letters[type]) * 16777619u;
+        hash = (hash ^ (unsigned)SHAPES[type].width) * 16777619u;
+        for(int i = 0; i < SHAPES[type].width; i++){
+            for(int j = 0; j < SHAPES[type].width; j++){
+                hash = (hash ^ (unsigned)SHAPES[type].shape_array[i][j]) * 16777619u;
+            }
+        }
+    }
+    return hash;
+}
+
+
+/*!
+    @brief Убирает из конца строки перевод строки и пробелы
+
+    @param line Строка
+
+    @return int - длина строки
+
+     pieces.c trim_line
+*/
+
+static int trim_line(char *line){
+    int length = strlen(line);
+    while(length > 0 && isspace((unsigned char)line[length - 1])){
+        line[--length] = 0;
+    }
+    return length;
+}
+
+
+/*!
+    @brief Проверяет последнюю прочитанную фигуру
+
+    @param path Имя файла для сообщения об ошибке
+    @param line_number Строка файла, на которой закончилась фигура
+    @param letter Буква фигуры
+    @param shape Фигура
+    @param rows Количество прочитанных строк фигуры
+
+    @return int - 0 если фигура правильная, иначе -1
+
+     pieces.c check_piece
+*/
+
+static int check_piece(const char *path, int line_number, char letter, Shape *shape, int rows){
+    if(rows == 0){
+        fprintf(stderr, "%s:%d: piece '%c' has no rows\n", path, line_number, letter);
+        return -1;
+    }
+    if(rows != shape->width){
+        fprintf(stderr, "%s:%d: piece '%c' has %d rows, expected %d\n", path, line_number, letter, rows, shape->width);
+        return -1;
+    }
+    for(int i = 0; i < shape->width; i++){
+        for(int j = 0; j < shape->width; j++){
+            if(shape->shape_array[i][j]){
+                return 0;
+            }
+        }
+    }
+    fprintf(stderr, "%s:%d: piece '%c' is empty\n", path, line_number, letter);
+    return -1;
+}
+
+
+/*!
+    @brief Загружает набор фигур из файла
+
+    Вызывается один раз до engine_init, после set_board_width. Повороты фигур готовит engine_init. Если файл содержит
+    ошибку, она печатается в stderr с номером строки, а текущий набор не меняется.
+    @param path Путь к файлу набора фигур
+
+    @return int - 0 если набор загружен, иначе -1
+
+     pieces.c load_piece_set
+*/
+
+int load_piece_set(const char *path){
+    FILE *file = fopen(path, "r");
+    if(!file){
+        perror(path);
+        return -1;
+    }
+
+    Shape shapes[MAX_SHAPES];
+    char letters[MAX_SHAPES + 1] = {0};
+    int count = 0;
+    int rows = 0;
+    int line_number = 0;
+    int failed = 0;
+    char line[256];
+
+    while(!failed && fgets(line, sizeof(line), file)){
+        line_number++;
+        int length = trim_line(line);
+        if(length == 0 || line[0] == ';'){
+            continue;
+        }
+
+        if(length == 1 && isalnum((unsigned char)line[0])){
+            if(count > 0 && check_piece(path, line_number - 1, letters[count - 1], &shapes[count - 1], rows) != 0){
+                failed = 1;
+                break;
+            }
+            if(strchr(letters, line[0])){
+                fprintf(stderr, "%s:%d: piece '%c' is defined twice\n", path, line_number, line[0]);
+                failed = 1;
+                break;
+            }
+            if(count == MAX_SHAPES){
+                fprintf(stderr, "%s:%d: more than %d pieces\n", path, line_number, MAX_SHAPES);
+                failed = 1;
+                break;
+            }
+            memset(&shapes[count], 0, sizeof(Shape));
+            shapes[count].color = count + 1;
+            letters[count] = line[0];
+            count++;
+            rows = 0;
+            continue;
+        }
+
+        if(count == 0){
+            fprintf(stderr, "%s:%d: expected a piece letter\n", path, line_number);
+            failed = 1;
+            break;
+        }
+        Shape *shape = &shapes[count - 1];
+        if(rows == 0){
+            if(length > MAX_SHAPE_WIDTH || length > board_width){
+                fprintf(stderr, "%s:%d: piece '%c' is %d wide, at most %d allowed\n", path, line_number, letters[count - 1], length,
+                    MAX_SHAPE_WIDTH < board_width ? MAX_SHAPE_WIDTH : board_width);
+                failed = 1;
+                break;
+            }
+            shape->width = length;
+        }
+        if(length != shape->width || rows >= shape->width){
+            fprintf(stderr, "%s:%d: piece '%c' must be a %dx%d square\n", path, line_number, letters[count - 1], shape->width, shape->width);
+            failed = 1;
+            break;
+        }
+        for(int j = 0; j < length; j++){
+            if(line[j] != '.' && line[j] != '#'){
+                fprintf(stderr, "%s:%d: unexpected character '%c', use '.' or '#'\n", path, line_number, line[j]);
+                failed = 1;
+                break;
+            }
+            shape->shape_array[rows][j] = line[j] == '#';
+        }
+        rows++;
+    }
+    fclose(file);
+
+    if(!failed && count == 0){
+        fprintf(stderr, "%s: no pieces\n", path);
+        failed = 1;
+    }
+    if(!failed && check_piece(path, line_number, letters[count - 1], &shapes[count - 1], rows) != 0){
+        failed = 1;
+    }
+    if(failed){
+        return -1;
+    }
+
+    memcpy(SHAPES, shapes, count * sizeof(Shape));
+    memcpy(shape_letters, letters, sizeof(letters));
+    shapes_count = count;
+    return 0;
+}
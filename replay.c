@@ -0,0 +1,302 @@
+/*!
+    @file replay.c
+    @brief Запись игр и их повторная симуляция
+
+    Запись игры - текстовый файл. Первая строка - заголовок "CBRICKS <версия> <ширина> <высота> <хеш набора фигур>",
+    хеш считается piece_set_hash, запись с другим набором фигур не симулируется.
+    далее по одному событию в строке: "<время, мс> <тип> [аргументы]".
+    Типы событий:
+    s <индекс фигуры> <x> - появление фигуры,
+    k <код клавиши> - ввод,
+    g - шаг падения фигуры,
+    e <очки> - конец игры.
+*/
+
+#include "tetris.h"
+#include <string.h>
+
+static ReplayEvent *events;
+static int events_count;
+static const char *replay_dir = NULL;
+static struct timeval replay_start_time;
+
+
+/*!
+    @brief Задаёт папку для сохранения записей игр. Вызывается до начала игры
+
+    @param dir Папка для записей. NULL отключает запись
+
+     replay.c replay_configure
+*/
+
+void replay_configure(const char *dir){
+    replay_dir = dir;
+}
+
+
+/*!
+    @brief Начинает запись игры
+
+    Память под события выделяется один раз, чтобы запись не выделяла память во время игры.
+
+     replay.c replay_start
+*/
+
+void replay_start(){
+    events_count = 0;
+    if(replay_dir && !events){
+        events = (ReplayEvent*)malloc(REPLAY_MAX_EVENTS * sizeof(ReplayEvent));
+    }
+    gettimeofday(&replay_start_time, NULL);
+}
+
+
+/*!
+    @brief Добавляет событие в запись игры
+
+    Если запись отключена или переполнена, событие игнорируется.
+    @param type Тип события: 's', 'k', 'g' или 'e'
+    @param a Первый аргумент события
+    @param b Второй аргумент события
+
+     replay.c replay_record
+*/
+
+void replay_record(char type, int a, int b){
+    if(!replay_dir || !events || events_count >= REPLAY_MAX_EVENTS){
+        return;
+    }
+
+    struct timeval now;
+    gettimeofday(&now, NULL);
+    ReplayEvent *event = &events[events_count++];
+    event->time = elapsed_ms(replay_start_time, now);
+    event->type = type;
+    event->a = a;
+    event->b = b;
+}
+
+
+/*!
+    @brief Завершает запись и сохраняет её в файл
+
+    Запись, в которую не поместились все события, не сохраняется: её нельзя воспроизвести.
+    @param final_score Итоговые очки
+
+     replay.c replay_stop
+*/
+
+void replay_stop(int final_score){
+    if(!replay_dir || !events || events_count >= REPLAY_MAX_EVENTS){
+        return;
+    }
+    replay_record('e', final_score, 0);
+
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/%ld_%06ld.replay", replay_dir, (long)replay_start_time.tv_sec, (long)replay_start_time.tv_usec);
+    FILE *replay_file = fopen(path, "w");
+    if(!replay_file){
+        return;
+    }
+
+    fprintf(replay_file, "CBRICKS %d %d %d %u\n", REPLAY_VERSION, board_width, MAX_HEIGHT, piece_set_hash());
+    for(int i = 0; i < events_count; i++){
+        ReplayEvent *event = &events[i];
+        switch(event->type){
+            case 's':
+            fprintf(replay_file, "%ld s %d %d\n", event->time, event->a, event->b);
+            break;
+            case 'k':
+            case 'e':
+            fprintf(replay_file, "%ld %c %d\n", event->time, event->type, event->a);
+            break;
+            default:
+            fprintf(replay_file, "%ld %c\n", event->time, event->type);
+            break;
+        }
+    }
+    fclose(replay_file);
+}
+
+
+/*!
+    @brief Читает целое число из текста записи
+
+    @param p Текущая позиция
+    @param end Конец текста
+    @param[out] value Прочитанное число
+
+    @return const char* - позиция после числа или NULL, если числа нет
+
+     replay.c read_number
+*/
+
+static const char *read_number(const char *p, const char *end, long *value){
+    while(p < end && (*p == ' ' || *p == '\n' || *p == '\r')){
+        p++;
+    }
+
+    int sign = 1;
+    if(p < end && *p == '-'){
+        sign = -1;
+        p++;
+    }
+    if(p >= end || *p < '0' || *p > '9'){
+        return NULL;
+    }
+
+    long result = 0;
+    while(p < end && *p >= '0' && *p <= '9'){
+        result = result * 10 + (*p - '0');
+        p++;
+    }
+    *value = sign * result;
+    return p;
+}
+
+
+/*!
+    @brief Читает символ типа события из текста записи
+
+    @param p Текущая позиция
+    @param end Конец текста
+    @param[out] type Прочитанный символ
+
+    @return const char* - позиция после символа или NULL, если текст закончился
+
+     replay.c read_type
+*/
+
+static const char *read_type(const char *p, const char *end, char *type){
+    while(p < end && *p == ' '){
+        p++;
+    }
+    if(p >= end){
+        return NULL;
+    }
+    *type = *p;
+    return p + 1;
+}
+
+
+/*!
+    @brief Повторно проигрывает запись игры тем же кодом, что и основной цикл
+
+    Текст записи не обязан заканчиваться нулём, поэтому его можно передать прямо из mmap.
+    @param data Текст записи
+    @param size Размер текста
+    @param[out] stats Статистика игры
+
+    @return int - 0 если запись проиграна до конца, иначе -1
+
+     replay.c simulate_replay
+*/
+
+int simulate_replay(const char *data, size_t size, ReplayStats *stats){
+    memset(stats, 0, sizeof(*stats));
+
+    const char *p = data;
+    const char *end = data + size;
+    long version, width, height, pieces_hash;
+    if(size < 7 || memcmp(p, "CBRICKS", 7) != 0){
+        return -1;
+    }
+    p += 7;
+    p = read_number(p, end, &version);
+    if(p){
+        p = read_number(p, end, &width);
+    }
+    if(p){
+        p = read_number(p, end, &height);
+    }
+    if(p){
+        p = read_number(p, end, &pieces_hash);
+    }
+    if(!p || version != REPLAY_VERSION || width != board_width || height != MAX_HEIGHT || pieces_hash != (long)piece_set_hash()){
+        return -1;
+    }
+
+    Board *table = create_table();
+    Shape current_shape;
+    Shape next_shape;
+    int have_current_shape = 0;
+    int flag_generated_next_shape = 0;
+    int pause_flag = 1;
+    int check_for_manual_exit = 0;
+    int score = 0;
+    int level = 1;
+    int speed = 1;
+    int finished = 0;
+    int failed = 0;
+
+    while(!finished && !failed){
+        long time, a = 0, b = 0;
+        char type;
+        if(!(p = read_number(p, end, &time)) || !(p = read_type(p, end, &type))){
+            failed = 1;
+            break;
+        }
+
+        int placed = 0;
+        switch(type){
+            case 's':
+            if(!(p = read_number(p, end, &a)) || !(p = read_number(p, end, &b)) || a < 0 || a >= shapes_count){
+                failed = 1;
+                break;
+            }
+            Shape shape = SHAPES[a];
+            shape.x = b;
+            if(!have_current_shape){
+                current_shape = shape;
+                have_current_shape = 1;
+            }else{
+                next_shape = shape;
+                flag_generated_next_shape = 1;
+            }
+            break;
+            case 'k':
+            if(!(p = read_number(p, end, &a)) || !have_current_shape){
+                failed = 1;
+                break;
+            }
+            placed = flag_generated_next_shape;
+            parse_input(a, &current_shape, table, &pause_flag, &next_shape, &flag_generated_next_shape, &check_for_manual_exit);
+            placed = placed && !flag_generated_next_shape;
+            break;
+            case 'g':
+            if(!have_current_shape || !flag_generated_next_shape){
+                failed = 1;
+                break;
+            }
+            placed = gravity_step(&current_shape, next_shape, table, &flag_generated_next_shape);
+            break;
+            case 'e':
+            if(!(p = read_number(p, end, &a))){
+                failed = 1;
+                break;
+            }
+            stats->recorded_score = a;
+            finished = 1;
+            break;
+            default:
+            failed = 1;
+            break;
+        }
+
+        int lines = check_for_full_line(table, &score, &level, &speed);
+        if(lines > 0 && lines <= MAX_SHAPE_WIDTH){
+            stats->clears[lines]++;
+        }
+        if(placed){
+            stats->pieces++;
+            stats->stack_height_sum += stack_height(table);
+        }
+        stats->duration = time;
+    }
+
+    stats->score = score;
+    stats->level = level;
+    stats->lost = check_for_lose(table);
+    clear_table_memory(table);
+    return finished && !failed ? 0 : -1;
+}
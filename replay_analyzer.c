@@ -0,0 +1,221 @@
+/*!
+    @file replay_analyzer.c
+    @brief Параллельный анализ записанных игр
+
+    Повторно проигрывает все записи из папки на пуле потоков тем же игровым кодом, что и игра,
+    проверяет совпадение итоговых очков и собирает общую статистику.
+
+    Использование: replay_analyzer [-j потоки] [-w ширина] [-f файл_фигур] папка
+    Записи с другой шириной поля, другим набором фигур или другой версией формата считаются нечитаемыми.
+*/
+
+#include "tetris.h"
+#include <dirent.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define SCORE_BUCKET 1000 ///<Ширина интервала гистограммы очков
+#define SCORE_BUCKETS 20 ///<Количество интервалов гистограммы очков, последний включает все большие очки
+
+/*!
+    Структура, определяющая задачу анализа одной записи
+*/
+typedef struct replay_job{
+    char path[4096]; ///<Путь к записи
+    ReplayStats stats; ///<Статистика игры
+    int status; ///<0 - запись проиграна, -1 - файл не прочитан или повреждён
+}ReplayJob;
+
+
+/*!
+    @brief Проигрывает одну запись, отображённую в память
+
+    @param arg Указатель на ReplayJob
+
+     replay_analyzer.c analyze_replay
+*/
+
+static void analyze_replay(void *arg){
+    ReplayJob *job = (ReplayJob*)arg;
+    job->status = -1;
+
+    int fd = open(job->path, O_RDONLY);
+    if(fd < 0){
+        return;
+    }
+    struct stat file_stat;
+    if(fstat(fd, &file_stat) == 0 && file_stat.st_size > 0){
+        void *data = mmap(NULL, file_stat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if(data != MAP_FAILED){
+            madvise(data, file_stat.st_size, MADV_SEQUENTIAL);
+            job->status = simulate_replay((const char*)data, file_stat.st_size, &job->stats);
+            munmap(data, file_stat.st_size);
+        }
+    }
+    close(fd);
+}
+
+
+/*!
+    @brief Собирает пути ко всем записям в папке
+
+    @param dir_path Папка с записями
+    @param[out] count Количество найденных записей
+
+    @return ReplayJob* - массив задач или NULL, если папку не удалось открыть
+
+     replay_analyzer.c collect_jobs
+*/
+
+static ReplayJob *collect_jobs(const char *dir_path, int *count){
+    DIR *dir = opendir(dir_path);
+    if(!dir){
+        return NULL;
+    }
+
+    int capacity = 256;
+    ReplayJob *jobs = (ReplayJob*)malloc(capacity * sizeof(ReplayJob));
+    *count = 0;
+
+    struct dirent *entry;
+    while((entry = readdir(dir))){
+        size_t length = strlen(entry->d_name);
+        if(length < 7 || strcmp(entry->d_name + length - 7, ".replay") != 0){
+            continue;
+        }
+        if(*count == capacity){
+            capacity *= 2;
+            jobs = (ReplayJob*)realloc(jobs, capacity * sizeof(ReplayJob));
+        }
+        snprintf(jobs[*count].path, sizeof(jobs[*count].path), "%s/%s", dir_path, entry->d_name);
+        (*count)++;
+    }
+    closedir(dir);
+    return jobs;
+}
+
+
+static int compare_ints(const void *a, const void *b){
+    return (*(const int*)a > *(const int*)b) - (*(const int*)a < *(const int*)b);
+}
+
+
+/*!
+    @brief Печатает общую статистику по всем играм
+
+    @param jobs Массив задач
+    @param count Количество задач
+
+    @return int - количество игр, очки которых не совпали с записанными
+
+     replay_analyzer.c print_report
+*/
+
+static int print_report(ReplayJob *jobs, int count){
+    int analyzed = 0, broken = 0, mismatched = 0, lost = 0;
+    long clears[MAX_SHAPE_WIDTH + 1] = {0};
+    long pieces = 0, stack_height_sum = 0;
+    double duration_sum = 0;
+    int histogram[SCORE_BUCKETS] = {0};
+    int *scores = (int*)malloc((count ? count : 1) * sizeof(int));
+
+    for(int i = 0; i < count; i++){
+        ReplayStats *stats = &jobs[i].stats;
+        if(jobs[i].status != 0){
+            broken++;
+            continue;
+        }
+        if(stats->score != stats->recorded_score){
+            mismatched++;
+            printf("score mismatch: %s recorded %d simulated %d\n", jobs[i].path, stats->recorded_score, stats->score);
+        }
+        scores[analyzed++] = stats->score;
+        int bucket = stats->score / SCORE_BUCKET;
+        histogram[bucket < SCORE_BUCKETS ? bucket : SCORE_BUCKETS - 1]++;
+        for(int lines = 1; lines <= MAX_SHAPE_WIDTH; lines++){
+            clears[lines] += stats->clears[lines];
+        }
+        pieces += stats->pieces;
+        stack_height_sum += stats->stack_height_sum;
+        if(stats->lost){
+            lost++;
+            duration_sum += stats->duration;
+        }
+    }
+
+    printf("games: %d analyzed, %d unreadable, %d score mismatches\n", analyzed, broken, mismatched);
+    if(analyzed){
+        qsort(scores, analyzed, sizeof(int), compare_ints);
+        printf("score: min %d, median %d, p90 %d, max %d\n", scores[0], scores[analyzed / 2], scores[analyzed * 9 / 10], scores[analyzed - 1]);
+        for(int i = 0; i < SCORE_BUCKETS; i++){
+            if(histogram[i]){
+                printf("  %6d%s %d\n", i * SCORE_BUCKET, i == SCORE_BUCKETS - 1 ? "+:" : ": ", histogram[i]);
+            }
+        }
+        printf("clears: singles %ld, doubles %ld, triples %ld, tetrises %ld, 5-line %ld\n", clears[1], clears[2], clears[3], clears[4], clears[5]);
+        printf("average stack height: %.2f\n", pieces ? (double)stack_height_sum / pieces : 0.0);
+        printf("average time to death: %.1f s over %d lost games\n", lost ? duration_sum / lost / 1000.0 : 0.0, lost);
+    }
+    free(scores);
+    return mismatched;
+}
+
+
+int main(int argc, char **argv){
+    int threads = 0;
+    int width = MAX_WIDTH;
+    const char *pieces_path = NULL;
+    int opt;
+    while((opt = getopt(argc, argv, "j:w:f:")) != -1){
+        switch(opt){
+            case 'j':
+            threads = atoi(optarg);
+            break;
+            case 'w':
+            width = atoi(optarg);
+            break;
+            case 'f':
+            pieces_path = optarg;
+            break;
+            default:
+            fprintf(stderr, "usage: %s [-j threads] [-w width] [-f pieces_file] replay_dir\n", argv[0]);
+            return 1;
+        }
+    }
+    if(optind >= argc || set_board_width(width) != 0){
+        fprintf(stderr, "usage: %s [-j threads] [-w width] [-f pieces_file] replay_dir\n", argv[0]);
+        return 1;
+    }
+    if(pieces_path && load_piece_set(pieces_path) != 0){
+        return 1;
+    }
+    engine_init();
+
+    int count = 0;
+    ReplayJob *jobs = collect_jobs(argv[optind], &count);
+    if(!jobs){
+        perror(argv[optind]);
+        return 1;
+    }
+
+    struct timeval start_time, end_time;
+    gettimeofday(&start_time, NULL);
+
+    ThreadPool *pool = thread_pool_create(threads);
+    for(int i = 0; i < count; i++){
+        thread_pool_submit(pool, analyze_replay, &jobs[i]);
+    }
+    thread_pool_wait(pool);
+    gettimeofday(&end_time, NULL);
+
+    int mismatched = print_report(jobs, count);
+    long elapsed = elapsed_ms(start_time, end_time);
+    printf("%d games in %ld ms on %d threads, %.0f games/sec\n", count, elapsed, pool->size, elapsed > 0 ? count * 1000.0 / elapsed : (double)count * 1000.0);
+
+    thread_pool_destroy(pool);
+    free(jobs);
+    return mismatched ? 2 : 0;
+}
@@ -0,0 +1,112 @@
+/*!
+    @file shm_export.c
+    @brief Публикация состояния игры в разделяемой памяти
+
+    Состояние пишется в файл /dev/shm/c_bricks.<pid>, отображённый в память.
+    Запись защищена seqlock: читатели никогда не блокируют игру, а после настройки
+    публикация кадра не делает ни одного системного вызова.
+*/
+
+#include "tetris.h"
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+static SharedState *shared_state;
+static char shared_state_path[64];
+
+
+/*!
+    @brief Создаёт файл состояния в /dev/shm и отображает его в память
+
+    Если файл создать не удалось, игра продолжается без публикации.
+
+     shm_export.c shm_export_start
+*/
+
+void shm_export_start(){
+    snprintf(shared_state_path, sizeof(shared_state_path), SHARED_STATE_PATH_FORMAT, (int)getpid());
+    int fd = open(shared_state_path, O_CREAT | O_RDWR | O_TRUNC, 0644);
+    if(fd < 0){
+        return;
+    }
+    if(ftruncate(fd, sizeof(SharedState)) == 0){
+        void *memory = mmap(NULL, sizeof(SharedState), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if(memory != MAP_FAILED){
+            shared_state = (SharedState*)memory;
+        }
+    }
+    close(fd);
+
+    if(!shared_state){
+        unlink(shared_state_path);
+        return;
+    }
+    shared_state->magic = SHARED_STATE_MAGIC;
+    shared_state->version = SHARED_STATE_VERSION;
+    shared_state->width = board_width;
+    shared_state->height = MAX_HEIGHT;
+    atomic_store_explicit(&shared_state->sequence, 0, memory_order_release);
+}
+
+
+/*!
+    @brief Публикует состояние игры за текущий тик
+
+    @param table Игровое поле
+    @param current_shape Текущая фигура
+    @param next_shape Следующая фигура
+    @param score Очки
+    @param level Уровень
+    @param speed Скорость
+    @param pause_flag Флаг паузы
+
+     shm_export.c shm_export_publish
+*/
+
+void shm_export_publish(Board *table, Shape current_shape, Shape next_shape, int score, int level, int speed, int pause_flag){
+    if(!shared_state){
+        return;
+    }
+
+    //Нечётный номер говорит читателям, что запись идёт
+    unsigned sequence = atomic_load_explicit(&shared_state->sequence, memory_order_relaxed);
+    atomic_store_explicit(&shared_state->sequence, sequence + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    for(int i = 0; i < MAX_HEIGHT; i++){
+        memcpy(shared_state->board[i], table->cells[i], board_width);
+    }
+    shared_state->current_shape = current_shape;
+    shared_state->next_shape = next_shape;
+    shared_state->score = score;
+    shared_state->level = level;
+    shared_state->speed = speed;
+    shared_state->paused = pause_flag == -1;
+    shared_state->frame++;
+
+    atomic_store_explicit(&shared_state->sequence, sequence + 2, memory_order_release);
+}
+
+
+/*!
+    @brief Отмечает конец игры, снимает отображение и удаляет файл состояния
+
+     shm_export.c shm_export_stop
+*/
+
+void shm_export_stop(){
+    if(!shared_state){
+        return;
+    }
+    unsigned sequence = atomic_load_explicit(&shared_state->sequence, memory_order_relaxed);
+    atomic_store_explicit(&shared_state->sequence, sequence + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    shared_state->finished = 1;
+    atomic_store_explicit(&shared_state->sequence, sequence + 2, memory_order_release);
+
+    munmap(shared_state, sizeof(SharedState));
+    shared_state = NULL;
+    unlink(shared_state_path);
+}
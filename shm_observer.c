@@ -0,0 +1,88 @@
+/*!
+    @file shm_observer.c
+    @brief Чтение состояния игры, опубликованного shm_export.c
+
+    Читатель только отображает файл в память и копирует снимок, не блокируя игру.
+*/
+
+#include "tetris.h"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+
+/*!
+    @brief Открывает опубликованное состояние игры только для чтения
+
+    @param path Путь к файлу состояния, например /dev/shm/c_bricks.1234
+
+    @return const SharedState* - отображённое состояние или NULL, если файл не подходит
+
+     shm_observer.c shared_state_open
+*/
+
+const SharedState *shared_state_open(const char *path){
+    int fd = open(path, O_RDONLY);
+    if(fd < 0){
+        return NULL;
+    }
+    void *memory = mmap(NULL, sizeof(SharedState), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if(memory == MAP_FAILED){
+        return NULL;
+    }
+
+    const SharedState *shared = (const SharedState*)memory;
+    if(shared->magic != SHARED_STATE_MAGIC || shared->version != SHARED_STATE_VERSION){
+        munmap(memory, sizeof(SharedState));
+        return NULL;
+    }
+    return shared;
+}
+
+
+/*!
+    @brief Копирует согласованный снимок состояния
+
+    Если игра в этот момент пишет кадр, чтение повторяется через SHARED_STATE_RETRY_US.
+    Запись кадра занимает микросекунды, поэтому если согласованный снимок не удалось
+    прочитать за SHARED_STATE_READ_ATTEMPTS попыток, игра считается завершившейся посреди записи.
+    @param shared Отображённое состояние
+    @param[out] snapshot Снимок состояния
+
+    @return int - 0 если снимок прочитан, -1 если игра не закончила запись кадра
+
+     shm_observer.c shared_state_read
+*/
+
+int shared_state_read(const SharedState *shared, SharedState *snapshot){
+    SharedState *source = (SharedState*)shared;
+    struct timespec retry_delay = {0, SHARED_STATE_RETRY_US * 1000L};
+    for(int attempt = 0; attempt < SHARED_STATE_READ_ATTEMPTS; attempt++){
+        unsigned before = atomic_load_explicit(&source->sequence, memory_order_acquire);
+        if(!(before & 1)){
+            *snapshot = *shared;
+            atomic_thread_fence(memory_order_acquire);
+            unsigned after = atomic_load_explicit(&source->sequence, memory_order_relaxed);
+            if(before == after){
+                return 0;
+            }
+        }
+        nanosleep(&retry_delay, NULL);
+    }
+    return -1;
+}
+
+
+/*!
+    @brief Снимает отображение состояния
+
+    @param shared Отображённое состояние
+
+     shm_observer.c shared_state_close
+*/
+
+void shared_state_close(const SharedState *shared){
+    munmap((void*)shared, sizeof(SharedState));
+}
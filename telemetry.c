@@ -0,0 +1,273 @@
+/*!
+    @file telemetry.c
+    @brief Сбор метрик игровой сессии
+
+    Игровой цикл только кладёт события в заранее выделенное кольцо,
+    запись в файл выполняет фоновый поток.
+*/
+
+#include "tetris.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <errno.h>
+#include <string.h>
+
+static TelemetryEvent ring[TELEMETRY_RING_SIZE];
+static atomic_ulong ring_head; ///<Индекс следующей записи, двигает только игровой цикл
+static atomic_ulong ring_tail; ///<Индекс следующего чтения, двигает только поток записи
+static atomic_ulong dropped_events;
+
+static const char *stream_path = NULL;
+static const char *summary_path = NULL;
+
+static pthread_t flush_thread;
+static pthread_mutex_t flush_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t flush_cond = PTHREAD_COND_INITIALIZER;
+static int stop_requested;
+static int running;
+
+static FILE *stream_file;
+static struct timeval session_start;
+static long session_id;
+
+/*!
+    Итоги сессии, которые поток записи накапливает по мере разбора событий
+*/
+static struct {
+    long pieces;
+    long inputs;
+    long clears[MAX_SHAPE_WIDTH + 1]; ///<Количество очисток по числу одновременно убранных линий
+    long level_time[11]; ///<Время, проведённое на каждом уровне, мс
+    int level; ///<Текущий уровень
+    long level_start; ///<Момент перехода на текущий уровень, мс
+    long last_time; ///<Время последнего события, мс
+} totals;
+
+static const char *event_names[] = {"piece", "input", "lines", "level", "game_over"};
+
+
+/*!
+    @brief Учитывает событие в итогах сессии
+
+    @param event Событие телеметрии
+
+     telemetry.c account_event
+*/
+
+static void account_event(TelemetryEvent *event){
+    totals.last_time = event->time;
+    switch(event->type){
+        case TELEMETRY_PIECE_PLACED:
+        totals.pieces++;
+        break;
+        case TELEMETRY_INPUT:
+        totals.inputs++;
+        break;
+        case TELEMETRY_LINES_CLEARED:
+        if(event->value > 0 && event->value <= MAX_SHAPE_WIDTH){
+            totals.clears[event->value]++;
+        }
+        break;
+        case TELEMETRY_LEVEL_UP:
+        case TELEMETRY_GAME_OVER:
+        if(totals.level >= 1 && totals.level <= 10){
+            totals.level_time[totals.level] += event->time - totals.level_start;
+        }
+        totals.level = event->value;
+        totals.level_start = event->time;
+        break;
+    }
+}
+
+
+/*!
+    @brief Забирает накопленные события из кольца и записывает их в поток CSV
+
+     telemetry.c drain_ring
+*/
+
+static void drain_ring(){
+    unsigned long tail = atomic_load_explicit(&ring_tail, memory_order_relaxed);
+    unsigned long head = atomic_load_explicit(&ring_head, memory_order_acquire);
+
+    for(; tail != head; tail++){
+        TelemetryEvent *event = &ring[tail % TELEMETRY_RING_SIZE];
+        account_event(event);
+        if(stream_file){
+            fprintf(stream_file, "%ld,%ld,%s,%d,%d\n", session_id, event->time, event_names[event->type], event->value, event->extra);
+        }
+    }
+    atomic_store_explicit(&ring_tail, tail, memory_order_release);
+
+    if(stream_file){
+        fflush(stream_file);
+    }
+}
+
+
+/*!
+    @brief Фоновый поток, периодически сбрасывающий события на диск
+
+     telemetry.c flush_loop
+*/
+
+static void *flush_loop(void *arg){
+    (void)arg;
+    pthread_mutex_lock(&flush_mutex);
+    while(!stop_requested){
+        struct timeval now;
+        gettimeofday(&now, NULL);
+        struct timespec deadline;
+        deadline.tv_sec = now.tv_sec;
+        deadline.tv_nsec = (now.tv_usec + TELEMETRY_FLUSH_INTERVAL * 1000L) * 1000L;
+        deadline.tv_sec += deadline.tv_nsec / 1000000000L;
+        deadline.tv_nsec %= 1000000000L;
+
+        int rc = 0;
+        while(!stop_requested && rc != ETIMEDOUT){
+            rc = pthread_cond_timedwait(&flush_cond, &flush_mutex, &deadline);
+        }
+
+        pthread_mutex_unlock(&flush_mutex);
+        drain_ring();
+        pthread_mutex_lock(&flush_mutex);
+    }
+    pthread_mutex_unlock(&flush_mutex);
+    return NULL;
+}
+
+
+/*!
+    @brief Записывает итоги сессии рядом с файлом рекорда
+
+    @param final_score Итоговые очки
+
+     telemetry.c write_summary
+*/
+
+static void write_summary(int final_score){
+    FILE *summary_file = fopen(summary_path, "w");
+    if(!summary_file){
+        return;
+    }
+
+    double seconds = totals.last_time / 1000.0;
+    fprintf(summary_file, "session: %ld\n", session_id);
+    fprintf(summary_file, "score: %d\n", final_score);
+    fprintf(summary_file, "duration_ms: %ld\n", totals.last_time);
+    fprintf(summary_file, "pieces: %ld\n", totals.pieces);
+    fprintf(summary_file, "pieces_per_sec: %.2f\n", seconds > 0 ? totals.pieces / seconds : 0.0);
+    fprintf(summary_file, "inputs_per_min: %.1f\n", seconds > 0 ? totals.inputs * 60.0 / seconds : 0.0);
+    fprintf(summary_file, "singles: %ld\ndoubles: %ld\ntriples: %ld\ntetrises: %ld\nfive_lines: %ld\n", totals.clears[1], totals.clears[2], totals.clears[3], totals.clears[4], totals.clears[5]);
+    for(int level = 1; level <= 10; level++){
+        if(totals.level_time[level]){
+            fprintf(summary_file, "level_%d_ms: %ld\n", level, totals.level_time[level]);
+        }
+    }
+    fprintf(summary_file, "dropped_events: %lu\n", atomic_load(&dropped_events));
+    fclose(summary_file);
+}
+
+
+/*!
+    @brief Задаёт файлы для записи телеметрии. Вызывается до начала игры
+
+    @param stream CSV файл, в который дописываются события. NULL отключает запись событий
+    @param summary Файл с итогами последней сессии. NULL отключает итоги
+
+     telemetry.c telemetry_configure
+*/
+
+void telemetry_configure(const char *stream, const char *summary){
+    stream_path = stream;
+    summary_path = summary;
+}
+
+
+/*!
+    @brief Начинает сессию телеметрии и запускает поток записи
+
+     telemetry.c telemetry_start
+*/
+
+void telemetry_start(){
+    gettimeofday(&session_start, NULL);
+    session_id = session_start.tv_sec;
+    atomic_store(&ring_head, 0);
+    atomic_store(&ring_tail, 0);
+    atomic_store(&dropped_events, 0);
+    memset(&totals, 0, sizeof(totals));
+    totals.level = 1;
+    stop_requested = 0;
+
+    stream_file = NULL;
+    if(stream_path){
+        stream_file = fopen(stream_path, "a");
+        if(stream_file && ftell(stream_file) == 0){
+            fprintf(stream_file, "session,time_ms,event,value,extra\n");
+        }
+    }
+
+    running = pthread_create(&flush_thread, NULL, flush_loop, NULL) == 0;
+}
+
+
+/*!
+    @brief Кладёт событие в кольцо телеметрии
+
+    Не выполняет ввода-вывода и не блокируется. Если кольцо заполнено, событие отбрасывается.
+    @param type Тип события из TelemetryEventType
+    @param value Основное значение события
+    @param extra Дополнительное значение события
+
+     telemetry.c telemetry_record
+*/
+
+void telemetry_record(int type, int value, int extra){
+    unsigned long head = atomic_load_explicit(&ring_head, memory_order_relaxed);
+    unsigned long tail = atomic_load_explicit(&ring_tail, memory_order_acquire);
+    if(head - tail >= TELEMETRY_RING_SIZE){
+        atomic_fetch_add_explicit(&dropped_events, 1, memory_order_relaxed);
+        return;
+    }
+
+    struct timeval now;
+    gettimeofday(&now, NULL);
+    TelemetryEvent *event = &ring[head % TELEMETRY_RING_SIZE];
+    event->time = elapsed_ms(session_start, now);
+    event->type = type;
+    event->value = value;
+    event->extra = extra;
+    atomic_store_explicit(&ring_head, head + 1, memory_order_release);
+}
+
+
+/*!
+    @brief Завершает сессию: дожидается записи всех событий и сохраняет итоги
+
+    @param final_score Итоговые очки
+
+     telemetry.c telemetry_stop
+*/
+
+void telemetry_stop(int final_score){
+    telemetry_record(TELEMETRY_GAME_OVER, 0, final_score);
+
+    if(running){
+        pthread_mutex_lock(&flush_mutex);
+        stop_requested = 1;
+        pthread_cond_signal(&flush_cond);
+        pthread_mutex_unlock(&flush_mutex);
+        pthread_join(flush_thread, NULL);
+        running = 0;
+    }
+    drain_ring();
+
+    if(stream_file){
+        fclose(stream_file);
+        stream_file = NULL;
+    }
+    if(summary_path){
+        write_summary(final_score);
+    }
+}
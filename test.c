@@ -0,0 +1,235 @@
+/*!
+    @file test.c
+    @brief Модульные тесты движка на библиотеке check
+
+    Сборка и запуск: make test
+*/
+
+#include "tetris.h"
+#include <check.h>
+#include <string.h>
+
+
+/*!
+    @brief Проигрывает события одной клавиши и считает сдвиги фигуры
+
+    Нажатия, которые auto_repeat_press применяет сразу, и сдвиги auto_repeat_update
+    складываются, как в основном цикле. auto_repeat_update вызывается каждую миллисекунду.
+    @param times Моменты событий клавиши от терминала, мс, по возрастанию
+    @param count Количество событий
+    @param end Момент окончания проигрывания, мс
+
+    @return int - количество сдвигов фигуры
+
+     test.c count_moves
+*/
+
+static int count_moves(const long *times, int count, long end){
+    AutoRepeat auto_repeat = {0};
+    int moves = 0;
+    int next = 0;
+    for(long now = 0; now <= end; now++){
+        while(next < count && times[next] == now){
+            moves += auto_repeat_press(&auto_repeat, KEY_LEFT, now);
+            next++;
+        }
+        moves += auto_repeat_update(&auto_repeat, now);
+    }
+    return moves;
+}
+
+
+START_TEST(double_tap_100ms){
+    input_configure(INPUT_DAS, INPUT_ARR);
+    long times[] = {0, 100};
+    ck_assert_int_eq(count_moves(times, 2, 1000), 2);
+}
+END_TEST
+
+
+START_TEST(double_tap_300ms){
+    input_configure(INPUT_DAS, INPUT_ARR);
+    long times[] = {0, 300};
+    ck_assert_int_eq(count_moves(times, 2, 1000), 2);
+}
+END_TEST
+
+
+START_TEST(held_key_auto_repeats){
+    input_configure(INPUT_DAS, INPUT_ARR);
+
+    //Нажатие, начальная задержка терминала 500 мс, затем повторы каждые 33 мс до 1500 мс
+    long times[64];
+    int count = 0;
+    times[count++] = 0;
+    for(long time = 500; time <= 1500; time += 33){
+        times[count++] = time;
+    }
+    int moves = count_moves(times, count, 2000);
+
+    //Нажатие и первый повтор - по сдвигу, дальше после DAS сдвиги идут с периодом ARR
+    ck_assert_int_ge(moves, 2 + (1500 - 500 - INPUT_DAS) / INPUT_ARR);
+    ck_assert_int_lt(moves, count);
+}
+END_TEST
+
+
+START_TEST(repeats_before_das_are_skipped){
+    input_configure(INPUT_DAS, INPUT_ARR);
+    long times[] = {0, 30, 60, 90, 120};
+    ck_assert_int_eq(count_moves(times, 5, 1000), 1);
+}
+END_TEST
+
+
+/*!
+    @brief Убирает заполненные строки исходным обходом поля по клеткам
+
+    Эталон для сравнения с check_for_full_line: счётчик занятых клеток идёт по всем
+    клеткам поля подряд и переносится со строки на строку.
+    @param table Игровое поле
+
+    @return int - количество убранных линий
+
+     test.c reference_full_lines
+*/
+
+static int reference_full_lines(Board *table){
+    int lines = 0;
+    int counter = 0;
+    for(int i = 0; i < MAX_HEIGHT; i++){
+        for(int j = 0; j < board_width; j++){
+            if(table->cells[i][j] == 0){
+                counter = 0;
+                continue;
+            }
+            counter++;
+            if(counter == board_width){
+                clear_line(table, i);
+                move_lines_down(table, i);
+                lines++;
+                counter = 0;
+            }
+        }
+    }
+    return lines;
+}
+
+
+START_TEST(full_lines_match_reference){
+    //Специализированные ширины и две ширины общей версии
+    int widths[] = {10, 12, 13, 14, 16, 20};
+    unsigned seed = 1;
+    for(int w = 0; w < (int)(sizeof(widths) / sizeof(widths[0])); w++){
+        ck_assert_int_eq(set_board_width(widths[w]), 0);
+        for(int round = 0; round < 2000; round++){
+            Board table = {0};
+            Board expected;
+            for(int i = 0; i < MAX_HEIGHT; i++){
+                for(int j = 0; j < board_width; j++){
+                    table.cells[i][j] = rand_r(&seed) % 16 != 0;
+                }
+            }
+            expected = table;
+            int score = 0, level = 1, speed = 0;
+            int lines = check_for_full_line(&table, &score, &level, &speed);
+            ck_assert_int_eq(lines, reference_full_lines(&expected));
+            ck_assert_int_eq(memcmp(table.cells, expected.cells, sizeof(table.cells)), 0);
+        }
+    }
+    set_board_width(MAX_WIDTH);
+}
+END_TEST
+
+
+/*!
+    @brief Проверяет касание сбоку перебором всех клеток поворота
+
+    Эталон для сравнения с check_if_touches_left_border и check_if_touches_right_border
+    без проверки границ поля.
+    @param shape Фигура
+    @param table Игровое поле
+    @param step -1 для левой стороны, 1 для правой
+
+    @return int - 1 если касание есть, иначе 0
+
+     test.c reference_touches_side
+*/
+
+static int reference_touches_side(Shape shape, Board *table, int step){
+    const PieceOrientation *orientation = &piece_orientations[shape.color - 1][shape.rotation];
+    for(int k = 0; k < orientation->count; k++){
+        if(table->cells[shape.y + orientation->cell_rows[k]][shape.x + orientation->cell_columns[k] + step]){
+            return 1;
+        }
+    }
+    return 0;
+}
+
+
+START_TEST(side_touches_match_reference){
+    //У пентамино U и других фигур набора есть строки с пропуском между клетками
+    ck_assert_int_eq(load_piece_set("pentominoes.txt"), 0);
+    engine_init();
+    unsigned seed = 1;
+    int gapped = 0;
+    for(int type = 0; type < shapes_count; type++){
+        for(int rotation = 0; rotation < 4; rotation++){
+            const PieceOrientation *orientation = &piece_orientations[type][rotation];
+            gapped += !orientation->solid_rows;
+            for(int round = 0; round < 200; round++){
+                Board table = {0};
+                for(int i = 0; i < MAX_HEIGHT; i++){
+                    for(int j = 0; j < board_width; j++){
+                        table.cells[i][j] = rand_r(&seed) % 3 == 0;
+                    }
+                }
+                Shape shape = SHAPES[type];
+                shape.rotation = rotation;
+                shape.y = rand_r(&seed) % (MAX_HEIGHT - shape.width + 1);
+                //Фигура не касается границ поля: x + leftmost от 1, x + rightmost до board_width - 2
+                int span = board_width - 2 - orientation->rightmost + orientation->leftmost;
+                shape.x = 1 - orientation->leftmost + rand_r(&seed) % span;
+                for(int i = 0; i < orientation->count; i++){
+                    table.cells[shape.y + orientation->cell_rows[i]][shape.x + orientation->cell_columns[i]] = 0;
+                }
+                ck_assert_int_eq(check_if_touches_left_border(shape, &table), reference_touches_side(shape, &table, -1));
+                ck_assert_int_eq(check_if_touches_right_border(shape, &table), reference_touches_side(shape, &table, 1));
+            }
+        }
+    }
+    ck_assert_int_ge(gapped, 1);
+}
+END_TEST
+
+
+Suite *auto_repeat_suite(){
+    Suite *suite = suite_create("auto_repeat");
+    TCase *test_case = tcase_create("core");
+    tcase_add_test(test_case, double_tap_100ms);
+    tcase_add_test(test_case, double_tap_300ms);
+    tcase_add_test(test_case, held_key_auto_repeats);
+    tcase_add_test(test_case, repeats_before_das_are_skipped);
+    suite_add_tcase(suite, test_case);
+    return suite;
+}
+
+
+Suite *engine_suite(){
+    Suite *suite = suite_create("engine");
+    TCase *test_case = tcase_create("core");
+    tcase_add_test(test_case, full_lines_match_reference);
+    tcase_add_test(test_case, side_touches_match_reference);
+    suite_add_tcase(suite, test_case);
+    return suite;
+}
+
+
+int main(){
+    SRunner *runner = srunner_create(auto_repeat_suite());
+    srunner_add_suite(runner, engine_suite());
+    srunner_run_all(runner, CK_NORMAL);
+    int failed = srunner_ntests_failed(runner);
+    srunner_free(runner);
+    return failed != 0;
+}
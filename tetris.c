@@ -5,6 +5,60 @@
 
 #include "tetris.h"
 #include <unistd.h>
+#include <string.h>
+
+static int das_time = INPUT_DAS; ///<Задержка перед автоповтором, мс
+static int arr_time = INPUT_ARR; ///<Период автоповтора, мс
+
+/*!
+    Фигуры игры. Цвет фигуры на единицу больше её индекса в массиве.
+    Первые BUILTIN_SHAPES_COUNT - встроенный набор, load_piece_set заменяет его набором из файла
+*/
+Shape SHAPES[MAX_SHAPES] = {{0, 0, 2, {{1,1},
+                                               {1,1}}, 1, 0},
+
+                                    {0, 0, 3, {{1,1,0},
+                                               {0,1,1},
+                                               {0,0,0}}, 2, 0},
+
+                                    {0, 0, 3, {{0,1,0},
+                                               {1,1,1},
+                                               {0,0,0}}, 3, 0},
+
+                                    {0, 0, 3, {{0,1,1},
+                                               {1,1,0},
+                                               {0,0,0}}, 4, 0},
+
+                                    {0, 0, 3, {{1,0,0},
+                                               {1,1,1},
+                                               {0,0,0}}, 5, 0},
+
+                                    {0, 0, 3, {{0,0,1},
+                                               {1,1,1},
+                                               {0,0,0}}, 6, 0},
+
+                                    {0, 0, 4, {{1,1,1,1},
+                                               {0,0,0,0},
+                                               {0,0,0,0},
+                                               {0,0,0,0}}, 7, 0}};
+
+int board_width = MAX_WIDTH; ///<Ширина игрового поля текущей сессии
+
+
+/*!
+    @brief Готовит ключи Зобриста и повороты фигур текущего набора
+
+    Вызывается один раз в начале программы, после set_board_width и load_piece_set,
+    до создания первого поля.
+
+     tetris.c engine_init
+*/
+
+void engine_init(){
+    zobrist_init();
+    compile_piece_set();
+}
+
 
 /*!
     @brief Проверка на то, что поворот возможно осуществить
@@ -17,16 +71,15 @@
      tetris.c check_nonvalid_rotation
 */
 
-int check_nonvalid_rotation(Shape shape, char** table){
-    for(int i = 0; i < shape.width; i++){
-        for(int j = 0; j < shape.width; j++){
-            if(shape.shape_array[i][j] && shape.x + j >= MAX_WIDTH || 
-                shape.shape_array[i][j] && shape.y + i >= MAX_HEIGHT || 
-                shape.shape_array[i][j] && shape.x + j < 0 || 
-                shape.shape_array[i][j] && shape.y + i < 0 || 
-                shape.shape_array[i][j] && table[shape.y + i][shape.x + j]){
-                return 0;
-            }
+int check_nonvalid_rotation(Shape shape, Board *table){
+    const PieceOrientation *orientation = &piece_orientations[shape.color - 1][shape.rotation];
+    if(shape.x + orientation->leftmost < 0 || shape.x + orientation->rightmost >= board_width ||
+        shape.y + orientation->top < 0 || shape.y + orientation->lowest >= MAX_HEIGHT){
+        return 0;
+    }
+    for(int k = 0; k < orientation->count; k++){
+        if(table->cells[shape.y + orientation->cell_rows[k]][shape.x + orientation->cell_columns[k]]){
+            return 0;
         }
     }
     return 1;
@@ -42,30 +95,16 @@ int check_nonvalid_rotation(Shape shape, char** table){
 
 */
 
-void rotate_shape(Shape *shape, char** table){
+void rotate_shape(Shape *shape, Board *table){
 
-    for(int i = 0; i < shape->width; i++){
-        for(int j = i + 1; j < shape->width; j++){
-            char temp = shape->shape_array[i][j];
-            shape->shape_array[i][j] = shape->shape_array[j][i];
-            shape->shape_array[j][i] = temp;
+    //Если ни один поворот невозможен, после четырёх поворотов фигура вернётся в исходное положение
+    for(int attempt = 0; attempt < 4; attempt++){
+        shape->rotation = (shape->rotation + 1) & 3;
+        if (check_nonvalid_rotation(*shape, table)){
+            break;
         }
     }
-
-    //reverse each row
-    for(int i = 0; i < shape->width; i++){
-        int start = 0, end = shape->width - 1;
-        while(start < end){
-            char temp = shape->shape_array[i][start];
-            shape->shape_array[i][start] = shape->shape_array[i][end];
-            shape->shape_array[i][end] = temp;
-            start++;
-            end--;
-        }
-    }
-    if (!check_nonvalid_rotation(*shape, table)){
-        rotate_shape(shape, table);
-    }
+    memcpy(shape->shape_array, piece_orientations[shape->color - 1][shape->rotation].cells, sizeof(shape->shape_array));
 }
 
 
@@ -81,7 +120,7 @@ void rotate_shape(Shape *shape, char** table){
      tetris.c check_colored_intersection
 */
 
-int check_colored_intersection(Shape shape, Shape land_shape, char** buffer){
+int check_colored_intersection(Shape shape, Shape land_shape, Board *buffer){
     for(int i = 0; i < shape.width; i++){
         for(int j = 0; j < shape.width; j++){
             if((shape.x + j == land_shape.x + j) && (shape.y + i == land_shape.y + 1)){
@@ -95,36 +134,45 @@ int check_colored_intersection(Shape shape, Shape land_shape, char** buffer){
 //LCOV_EXCL_START
 
 /*!
-    @brief Создание временного массива и его заполнение данными игрового поля, текущей фигуры и фантома
+    @brief Заполнение буфера текущей фигурой и фантомом
 
+    Буфер выделяется один раз до начала игры и перезаписывается каждый кадр.
     @param current_shape Указатель на текущую фигуру.
     @param table Игровое поле
+    @param buffer Буфер, в который рисуются фигура и фантом
 
      tetris.c createandfillbuffer
 */
 
-char **create_and_fill_buffer(Shape current_shape, char** table){
-    char **buffer = (char**)calloc(MAX_HEIGHT, sizeof(char*));
-    for(int i = 0; i < MAX_HEIGHT; i++){
-        buffer[i] = (char*)calloc(MAX_WIDTH, sizeof(char));
-    }
+void create_and_fill_buffer(Shape current_shape, Board *table, Board *buffer){
+    memset(buffer->cells, 0, sizeof(buffer->cells));
 
     Shape land_point_shape = current_shape;
     while(!check_if_touches_another_shape(land_point_shape, table)){
         move_shape(&land_point_shape, 'd', table);
     }
 
-    for(int i = 0; i < current_shape.width; i++){
-        for(int j = 0; j < current_shape.width; j++){
-            if(current_shape.shape_array[i][j]) 
-                buffer[current_shape.y + i][current_shape.x + j] = current_shape.shape_array[i][j];
-
-            if(land_point_shape.shape_array[i][j] && check_colored_intersection(current_shape, land_point_shape, buffer)) 
-                buffer[land_point_shape.y + i][land_point_shape.x + j] = land_point_shape.shape_array[i][j];
-        }
+    const PieceOrientation *orientation = &piece_orientations[current_shape.color - 1][current_shape.rotation];
+    int draw_land_point = check_colored_intersection(current_shape, land_point_shape, buffer);
+    for(int k = 0; k < orientation->count; k++){
+        buffer->cells[current_shape.y + orientation->cell_rows[k]][current_shape.x + orientation->cell_columns[k]] = 1;
+        if(draw_land_point)
+            buffer->cells[land_point_shape.y + orientation->cell_rows[k]][land_point_shape.x + orientation->cell_columns[k]] = 1;
     }
+}
+
+/*!
+    @brief Выделяет память под пустое игровое поле
+
+    Поле и его хеш выделяются одним блоком.
+
+    @return Board* - игровое поле размером MAX_HEIGHT x board_width, заполненное нулями
+
+     tetris.c create_table
+*/
 
-    return buffer;
+Board *create_table(){
+    return (Board*)calloc(1, sizeof(Board));
 }
 
 /*!
@@ -135,10 +183,7 @@ char **create_and_fill_buffer(Shape current_shape, char** table){
      tetris.c clear_table_memory
 */
 
-void clear_table_memory(char** table){
-    for(int i = 0; i < MAX_HEIGHT; i++){
-        free(table[i]);
-    }
+void clear_table_memory(Board *table){
     free(table);
 }
 
@@ -157,19 +202,16 @@ void clear_table_memory(char** table){
      tetris.c check_if_touches_another_shape
 */
 
-int check_if_touches_another_shape(Shape shape, char** table){
-
-    for(int i = 0; i < shape.width; i++){
-        for(int j = 0; j < shape.width; j++){
-            if((shape.shape_array[i][j] && shape.y + i + 1 >= MAX_HEIGHT)){
-                return 1;
-            }
-            if((shape.shape_array[i][j] && table[shape.y + i + 1][shape.x + j])){
-                return 1;
-            }
+int check_if_touches_another_shape(Shape shape, Board *table){
+    const PieceOrientation *orientation = &piece_orientations[shape.color - 1][shape.rotation];
+    if(shape.y + orientation->lowest + 1 >= MAX_HEIGHT){
+        return 1;
+    }
+    for(int k = 0; k < orientation->count; k++){
+        if(table->cells[shape.y + orientation->cell_rows[k] + 1][shape.x + orientation->cell_columns[k]]){
+            return 1;
         }
     }
-
     return 0;
 }
 
@@ -186,13 +228,24 @@ int check_if_touches_another_shape(Shape shape, char** table){
 
 */
 
-int check_if_touches_left_border(Shape shape, char** table){
-    for(int i = 0; i < shape.width; i++){
-        for(int j = 0; j < shape.width; j++){
-            if((shape.shape_array[i][j] && shape.x + j <= 0) || (shape.shape_array[i][j] && table[shape.y + i][shape.x + j - 1])){
+int check_if_touches_left_border(Shape shape, Board *table){
+    const PieceOrientation *orientation = &piece_orientations[shape.color - 1][shape.rotation];
+    if(shape.x + orientation->leftmost <= 0){
+        return 1;
+    }
+    //Соседи остальных клеток строки - клетки самой фигуры, если в строке нет пропусков
+    if(orientation->solid_rows){
+        for(int i = orientation->top; i <= orientation->lowest; i++){
+            if(orientation->left[i] >= 0 && table->cells[shape.y + i][shape.x + orientation->left[i] - 1]){
                 return 1;
             }
         }
+        return 0;
+    }
+    for(int k = 0; k < orientation->count; k++){
+        if(table->cells[shape.y + orientation->cell_rows[k]][shape.x + orientation->cell_columns[k] - 1]){
+            return 1;
+        }
     }
     return 0;
 }
@@ -209,13 +262,24 @@ int check_if_touches_left_border(Shape shape, char** table){
 
 */
 
-int check_if_touches_right_border(Shape shape, char** table){
-    for(int i = 0; i < shape.width; i++){
-        for(int j = 0; j < shape.width; j++){
-            if((shape.shape_array[i][j] && shape.x + j + 1 >= MAX_WIDTH) || (shape.shape_array[i][j] && table[shape.y + i][shape.x + j + 1])){
+int check_if_touches_right_border(Shape shape, Board *table){
+    const PieceOrientation *orientation = &piece_orientations[shape.color - 1][shape.rotation];
+    if(shape.x + orientation->rightmost + 1 >= board_width){
+        return 1;
+    }
+    //Как в check_if_touches_left_border, при строках без пропусков проверяются только правые клетки строк
+    if(orientation->solid_rows){
+        for(int i = orientation->top; i <= orientation->lowest; i++){
+            if(orientation->right[i] >= 0 && table->cells[shape.y + i][shape.x + orientation->right[i] + 1]){
                 return 1;
             }
         }
+        return 0;
+    }
+    for(int k = 0; k < orientation->count; k++){
+        if(table->cells[shape.y + orientation->cell_rows[k]][shape.x + orientation->cell_columns[k] + 1]){
+            return 1;
+        }
     }
     return 0;
 }
@@ -232,7 +296,7 @@ int check_if_touches_right_border(Shape shape, char** table){
      tetris.c move_shape
 */
 
-void move_shape(Shape *shape, char direction, char** Table){
+void move_shape(Shape *shape, char direction, Board *Table){
     if(direction == 'd' && !check_if_touches_another_shape(*shape, Table)){
         shape->y++;
     }
@@ -251,19 +315,22 @@ void move_shape(Shape *shape, char direction, char** Table){
 /*!
     @brief Функция вписывает фигуру в игровое поле
 
+    Хеш поля обновляется по клеткам, которые стали занятыми.
     @param shape Указатель на текущую фигуру.
     @param table Игровое поле
 
      tetris.c write_shape_to_table
 */
 
-void write_shape_to_table(Shape shape, char** table){
+void write_shape_to_table(Shape shape, Board *table){
 
-    for(int i = 0; i < shape.width; i++){
-        for(int j = 0; j < shape.width; j++){
-            if(shape.shape_array[i][j]) 
-                table[shape.y + i][shape.x + j] = shape.shape_array[i][j];
+    const PieceOrientation *orientation = &piece_orientations[shape.color - 1][shape.rotation];
+    for(int k = 0; k < orientation->count; k++){
+        int row = shape.y + orientation->cell_rows[k], column = shape.x + orientation->cell_columns[k];
+        if(!table->cells[row][column]){
+            zobrist_toggle_cell(table, row, column);
         }
+        table->cells[row][column] = 1;
     }
 }
 
@@ -277,9 +344,10 @@ void write_shape_to_table(Shape shape, char** table){
      tetris.c clear_line
 */
 
-void clear_line(char **table, int line_number){
-    for (int i = 0; i < MAX_WIDTH; i++){
-        table[line_number][i] = 0;
+void clear_line(Board *table, int line_number){
+    zobrist_xor_rows(table, line_number, line_number);
+    for (int i = 0; i < board_width; i++){
+        table->cells[line_number][i] = 0;
     }
 }
 
@@ -293,12 +361,53 @@ void clear_line(char **table, int line_number){
      tetris.c move_lines_down
 */
 
-void move_lines_down(char **table, int line_number){
+void move_lines_down(Board *table, int line_number){
+    zobrist_xor_rows(table, 1, line_number);
     for(int i = line_number; i > 0; i--){
-        for(int j = 0; j < MAX_WIDTH; j++){
-            table[i][j] = table[i - 1][j];
+        for(int j = 0; j < board_width; j++){
+            table->cells[i][j] = table->cells[i - 1][j];
         }
     }
+    zobrist_xor_rows(table, 1, line_number);
+}
+
+
+/*!
+    @brief Поднимает поле на count строк и вставляет снизу мусорные строки
+
+    Строки не копируются по одной через move_lines_down: поле сдвигается одним memmove.
+    Все клетки меняют положение, поэтому хеш поля пересчитывается целиком.
+    @param table Игровое поле
+    @param count Количество мусорных строк
+    @param hole Столбец дырки, одинаковый во всех вставленных строках
+
+    @return int - 1 если занятые клетки вытолкнуты за верх поля, иначе 0
+
+     tetris.c insert_garbage_lines
+*/
+
+int insert_garbage_lines(Board *table, int count, int hole){
+    if(count <= 0){
+        return 0;
+    }
+    if(count > MAX_HEIGHT){
+        count = MAX_HEIGHT;
+    }
+
+    int overflow = 0;
+    for(int i = 0; i < count; i++){
+        for(int j = 0; j < board_width; j++){
+            overflow |= table->cells[i][j];
+        }
+    }
+    memmove(table->cells[0], table->cells[count], (MAX_HEIGHT - count) * sizeof(table->cells[0]));
+    for(int i = MAX_HEIGHT - count; i < MAX_HEIGHT; i++){
+        memset(table->cells[i], 0, sizeof(table->cells[i]));
+        memset(table->cells[i], 1, board_width);
+        table->cells[i][hole] = 0;
+    }
+    table_rehash(table);
+    return overflow != 0;
 }
 
 
@@ -310,58 +419,234 @@ void increase_level(int *level, int score, int *speed){
         
 }
 
+/*!
+    @brief Начисляет очки за одновременно убранные линии: 100, 300, 700, 1500, 3100
+
+    @param consecutive_lines Количество линий, от 1 до MAX_SHAPE_WIDTH
+
+    @return int - очки, 0 если количество линий вне этого диапазона
+
+     tetris.c define_added_score
+*/
+
 int define_added_score(int consecutive_lines){
-    switch(consecutive_lines){
-        case 1:
-            return 100;
-        case 2:
-            return 300;
-        case 3:
-            return 700;
-        case 4:
-            return 1500;
-        default:
-            return 0;
+    if(consecutive_lines < 1 || consecutive_lines > MAX_SHAPE_WIDTH){
+        return 0;
     }
+    return 100 * ((1 << consecutive_lines) - 1);
 }
 
 /*!
-    @Функция ищет строку, которая полностью состоит из 1
+    @brief Считает занятые клетки в конце строки поля
+
+    @param row Строка поля
+    @param from Первый столбец, с которого считаются клетки
+
+    @return int - количество занятых клеток подряд до правого края, не считая столбцов левее from
+
+     tetris.c trailing_cells
+*/
+
+static int trailing_cells(const char *row, int from){
+    int j = board_width;
+    while(j > from && row[j - 1]){
+        j--;
+    }
+    return board_width - j;
+}
+
+
+/*!
+    @brief Убирает заполненные строки поля любой ширины
 
-    В случае нахождения строки, очищает её и обновляет очки
+    Счётчик занятых клеток переносится со строки на строку, поэтому строка удаляется,
+    как только board_width занятых клеток встретились подряд при обходе поля по строкам.
+    Внутри строки после пустой клетки такой ряд набраться не может, поэтому проверяется
+    только начало строки до первой пустой клетки, а в следующую строку переносится её хвост.
     @param table Игровое поле
-    @param score Указатель на очки
 
-     tetris.c check_for_full_line
+    @return int - количество убранных линий
+
+     tetris.c clear_full_lines_generic
 */
 
-void check_for_full_line(char **table, int *score, int *level, int *speed){
+static int clear_full_lines_generic(Board *table){
 
     int consecituve_lines = 0;
     int counter = 0;
-    int line_counter = 0;
-    
+
     for(int i = 0; i < MAX_HEIGHT; i++){
-        for(int j = 0; j < MAX_WIDTH; j++){    
-            if (table[i][j] == 0){
-                counter = 0;
-                continue;
-            }
-            counter++;
-            if(counter == MAX_WIDTH){
-                line_counter = i;
-                clear_line(table, line_counter);
-                move_lines_down(table, line_counter);
-                consecituve_lines++;
-                counter = 0;
-            }
+        const char *empty_cell = memchr(table->cells[i], 0, board_width);
+        int prefix = empty_cell ? empty_cell - table->cells[i] : board_width;
+        if(counter + prefix < board_width){
+            counter = trailing_cells(table->cells[i], prefix + 1);
+            continue;
         }
+
+        //Ряд набрался на столбце board_width - counter - 1, обход строки продолжается со следующего
+        int column = board_width - counter;
+        //Хеш обновляется только по сдвинутым строкам
+        zobrist_xor_rows(table, 0, i);
+        memset(table->cells[i], 0, board_width);
+        memmove(table->cells[1], table->cells[0], i * sizeof(table->cells[0]));
+        zobrist_xor_rows(table, 0, i);
+        consecituve_lines++;
+        counter = trailing_cells(table->cells[i], column);
+    }
+    return consecituve_lines;
+}
+
+
+/*!
+    @brief Собирает строку поля шириной до 16 клеток в битовую маску
+
+    Строка читается по 8 клеток, умножение сносит младшие биты восьми байтов в старший байт.
+    Клетки поля равны 0 или 1, поэтому переносов между битами не бывает.
+    @param row Строка поля
+    @param width Ширина поля, константа в специализированных версиях
+
+    @return unsigned - маска, бит j равен 1 если клетка j занята
+
+     tetris.c row_mask
+*/
+
+static inline __attribute__((always_inline)) unsigned row_mask(const char *row, const int width){
+    unsigned mask = 0;
+    for(int j = 0; j < width; j += 8){
+        unsigned long long cells;
+        memcpy(&cells, row + j, sizeof(cells));
+        mask |= (unsigned)((cells * 0x0102040810204080ULL) >> 56) << j;
     }
+    return mask & ((1u << width) - 1);
+}
+
+
+/*!
+    @brief Считает занятые клетки в конце строки по её маске
+
+    @param mask Маска строки из row_mask
+    @param from Первый столбец, с которого считаются клетки
+    @param width Ширина поля
+
+    @return int - количество занятых клеток подряд до правого края, не считая столбцов левее from
+
+     tetris.c trailing_mask_cells
+*/
+
+static inline __attribute__((always_inline)) int trailing_mask_cells(unsigned mask, int from, const int width){
+    unsigned empty = ~mask & ((1u << width) - 1) & ~((1u << from) - 1);
+    if(empty == 0){
+        return width - from;
+    }
+    return width - 1 - (31 - __builtin_clz(empty));
+}
+
+
+/*!
+    @brief Убирает заполненные строки поля заданной ширины по битовым маскам строк
+
+    Тот же обход, что и в clear_full_lines_generic. Ширина передаётся константой,
+    поэтому после подстановки границы циклов и маски сворачиваются при компиляции.
+    @param table Игровое поле
+    @param width Ширина поля, не больше 16
+
+    @return int - количество убранных линий
+
+     tetris.c clear_full_lines_fixed
+*/
+
+static inline __attribute__((always_inline)) int clear_full_lines_fixed(Board *table, const int width){
+
+    int consecituve_lines = 0;
+    int counter = 0;
+
+    for(int i = 0; i < MAX_HEIGHT; i++){
+        unsigned mask = row_mask(table->cells[i], width);
+        //Клетка width в маске всегда пустая, поэтому prefix не больше width
+        int prefix = __builtin_ctz(~mask);
+        if(counter + prefix < width){
+            counter = trailing_mask_cells(mask, prefix + 1, width);
+            continue;
+        }
+
+        int column = width - counter;
+        zobrist_xor_rows(table, 0, i);
+        memset(table->cells[i], 0, width);
+        memmove(table->cells[1], table->cells[0], i * sizeof(table->cells[0]));
+        zobrist_xor_rows(table, 0, i);
+        consecituve_lines++;
+        counter = trailing_mask_cells(row_mask(table->cells[i], width), column, width);
+    }
+    return consecituve_lines;
+}
+
+
+/*!
+    Создаёт версию clear_full_lines_fixed для ширины поля width
+*/
+#define DEFINE_CLEAR_FULL_LINES(width) \
+    static int clear_full_lines_##width(Board *table){ \
+        return clear_full_lines_fixed(table, width); \
+    }
+
+DEFINE_CLEAR_FULL_LINES(10)
+DEFINE_CLEAR_FULL_LINES(12)
+DEFINE_CLEAR_FULL_LINES(14)
+DEFINE_CLEAR_FULL_LINES(16)
+
+static int (*clear_full_lines)(Board *table) = clear_full_lines_14; ///<Очистка строк для ширины поля, выбирается в set_board_width
+
+
+/*!
+    @brief Задаёт ширину игрового поля
+
+    Вызывается один раз до создания полей. Для ширин 10, 12, 14 и 16 выбирает
+    специализированную очистку строк, для остальных - общую.
+    @param width Ширина поля
+
+    @return int - 0 если ширина задана, -1 если она вне MIN_BOARD_WIDTH..MAX_BOARD_WIDTH
+
+     tetris.c set_board_width
+*/
+
+int set_board_width(int width){
+    if(width < MIN_BOARD_WIDTH || width > MAX_BOARD_WIDTH){
+        return -1;
+    }
+    board_width = width;
+    switch(width){
+        case 10: clear_full_lines = clear_full_lines_10; break;
+        case 12: clear_full_lines = clear_full_lines_12; break;
+        case 14: clear_full_lines = clear_full_lines_14; break;
+        case 16: clear_full_lines = clear_full_lines_16; break;
+        default: clear_full_lines = clear_full_lines_generic; break;
+    }
+    return 0;
+}
+
+
+/*!
+    @Функция ищет строку, которая полностью состоит из 1
+
+    В случае нахождения строки, очищает её и обновляет очки.
+    Строки убирает версия очистки, выбранная в set_board_width под ширину поля.
+    @param table Игровое поле
+    @param score Указатель на очки
+
+    @return int - количество убранных линий
+
+     tetris.c check_for_full_line
+*/
+
+int check_for_full_line(Board *table, int *score, int *level, int *speed){
+
+    int consecituve_lines = clear_full_lines(table);
     int added_score = define_added_score(consecituve_lines);
     *score += added_score;
     if (added_score != 0 && *score >= 600 * *level){
         increase_level(level, *score, speed);
     }
+    return consecituve_lines;
 }
 
 //LCOV_EXCL_START
@@ -378,10 +663,10 @@ void check_for_full_line(char **table, int *score, int *level, int *speed){
      tetris.c check_for_lose
 */
 
-int check_for_lose(char **table){
+int check_for_lose(Board *table){
     
-    for(int i = 0; i < MAX_WIDTH; i++){
-        if(table[0][i] == 1){
+    for(int i = 0; i < board_width; i++){
+        if(table->cells[0][i] == 1){
             return 1;
         }
     }
@@ -390,6 +675,71 @@ int check_for_lose(char **table){
 }
 
 
+/*!
+    @brief Считает количество миллисекунд между двумя моментами времени
+
+    @param start Начальный момент
+    @param end Конечный момент
+
+    @return long - разница в миллисекундах
+
+     tetris.c elapsed_ms
+*/
+
+long elapsed_ms(struct timeval start, struct timeval end){
+    return (end.tv_sec - start.tv_sec) * 1000 + (end.tv_usec - start.tv_usec) / 1000;
+}
+
+
+/*!
+    @brief Шаг падения фигуры
+
+    Если фигура уже касается поля, она записывается в него, а её место занимает следующая фигура.
+    @param current_shape Указатель на текущую фигуру
+    @param next_shape Следующая фигура
+    @param table Игровое поле
+    @param flag_generated_next_shape Флаг генерации следующей фигуры. Сбрасывается, если фигура записана в поле
+
+    @return int - 1 если фигура записана в поле, иначе 0
+
+     tetris.c gravity_step
+*/
+
+int gravity_step(Shape *current_shape, Shape next_shape, Board *table, int *flag_generated_next_shape){
+    int placed = 0;
+    if(check_if_touches_another_shape(*current_shape, table)){
+        write_shape_to_table(*current_shape, table);
+        *current_shape = next_shape;
+        *flag_generated_next_shape = 0;
+        placed = 1;
+    }
+    move_shape(current_shape, 'd', table);
+    return placed;
+}
+
+
+/*!
+    @brief Считает высоту занятой части игрового поля
+
+    @param table Игровое поле
+
+    @return int - количество строк от самой верхней непустой строки до дна
+
+     tetris.c stack_height
+*/
+
+int stack_height(Board *table){
+    for(int i = 0; i < MAX_HEIGHT; i++){
+        for(int j = 0; j < board_width; j++){
+            if(table->cells[i][j]){
+                return MAX_HEIGHT - i;
+            }
+        }
+    }
+    return 0;
+}
+
+
 /**
     @brief Генерирует следующую фигуру
 
@@ -400,16 +750,35 @@ int check_for_lose(char **table){
      tetris.c getnextshape
 */
 
-void get_next_shape(Shape ShapesArr[], Shape *next_shape, int *flag_generated_next_shape){
+void get_next_shape(const Shape ShapesArr[], Shape *next_shape, int *flag_generated_next_shape){
     if(!*flag_generated_next_shape){
-        *next_shape = ShapesArr[rand() % 7];
-        next_shape->x = rand() & (MAX_WIDTH - next_shape->width);
+        *next_shape = ShapesArr[rand() % shapes_count];
+        next_shape->x = rand() & (board_width - next_shape->width);
         *flag_generated_next_shape = 1;
     }
 }
 
 
 
+/*!
+    @brief Генерирует следующую фигуру по сиду игры
+
+    Повторяет get_next_shape, но не использует общее состояние rand(), поэтому игры в разных
+    потоках не влияют друг на друга и воспроизводимы.
+    @param seed Указатель на состояние генератора
+
+    @return Shape - новая фигура
+
+     tetris.c next_seeded_shape
+*/
+
+Shape next_seeded_shape(unsigned *seed){
+    Shape shape = SHAPES[rand_r(seed) % shapes_count];
+    shape.x = rand_r(seed) & (board_width - shape.width);
+    return shape;
+}
+
+
 /**
     @brief Обрабатывает ввод с клавиатуры
 
@@ -418,12 +787,12 @@ void get_next_shape(Shape ShapesArr[], Shape *next_shape, int *flag_generated_ne
     @param table Игровое поле
     @param pause_flag Указатель на флаг паузы
     @param next_shape Указатель на следующую фигуру
-    @param flag_generated_next_shape Флаг генерации следующей фигуры
+    @param flag_generated_next_shape Флаг генерации следующей фигуры. Сбрасывается, если пробел уронил фигуру в поле
 
     \snippet tetris.c parseinput
 */
 
-void parse_input(int input, Shape *current_shape, char** Table, int *pause_flag, Shape *next_shape, int *flag_generated_next_shape, int *check_for_manual_exit){
+void parse_input(int input, Shape *current_shape, Board *Table, int *pause_flag, Shape *next_shape, int *flag_generated_next_shape, int *check_for_manual_exit){
     switch(input){
         case KEY_LEFT:
         if(*pause_flag == 1){
@@ -443,6 +812,14 @@ void parse_input(int input, Shape *current_shape, char** Table, int *pause_flag,
 
         }
         break;
+        case ' ':
+        if(*pause_flag == 1 && *flag_generated_next_shape){
+            while(!check_if_touches_another_shape(*current_shape, Table)){
+                current_shape->y++;
+            }
+            gravity_step(current_shape, *next_shape, Table, flag_generated_next_shape);
+        }
+        break;
         case 'p':
         if(*pause_flag == 1 || *pause_flag == -1){
             *pause_flag *= -1;
@@ -458,8 +835,143 @@ void parse_input(int input, Shape *current_shape, char** Table, int *pause_flag,
 }
 
 
+/*!
+    @brief Задаёт задержку автоповтора и его период. Вызывается до начала игры
+
+    @param das Задержка перед автоповтором, мс
+    @param arr Период автоповтора, мс. 0 - фигура сразу сдвигается до упора
+
+     tetris.c input_configure
+*/
+
+void input_configure(int das, int arr){
+    das_time = das;
+    arr_time = arr;
+}
+
+
+/*!
+    @brief Проверяет, что клавиша управляется автоповтором
+
+    @param input Ввод с клавиатуры
+
+    @return int - 1 для стрелок влево, вправо и вниз, иначе 0
+
+     tetris.c is_repeatable_input
+*/
+
+int is_repeatable_input(int input){
+    return input == KEY_LEFT || input == KEY_RIGHT || input == KEY_DOWN;
+}
+
+
+/*!
+    @brief Учитывает нажатие клавиши со стрелкой
+
+    Терминал не сообщает об отпускании клавиш, а удерживаемую клавишу повторяет сам:
+    после начальной задержки 250-660 мс - с периодом 30-50 мс. Событие той же клавиши,
+    пришедшее позже INPUT_RELEASE_TIMEOUT после предыдущего, - новое нажатие, оно
+    применяется сразу, поэтому быстрые двойные нажатия не теряются. Более частые события -
+    повторы терминала, они фигуру не двигают. Когда повторы идут непрерывно дольше das_time,
+    включается автоповтор, и дальше auto_repeat_update сдвигает фигуру с периодом arr_time.
+    @param auto_repeat Состояние автоповтора
+    @param input Клавиша
+    @param now Текущее время, мс
+
+    @return int - 1 если клавишу нужно применить сразу, иначе 0
+
+     tetris.c auto_repeat_press
+*/
+
+int auto_repeat_press(AutoRepeat *auto_repeat, int input, long now){
+    int apply = 0;
+    if(auto_repeat->key != input || now - auto_repeat->last_event > INPUT_RELEASE_TIMEOUT){
+        auto_repeat->key = input;
+        auto_repeat->repeating = 0;
+        auto_repeat->pressed = now;
+        apply = 1;
+    }else if(!auto_repeat->repeating && now - auto_repeat->pressed >= das_time){
+        auto_repeat->repeating = 1;
+        auto_repeat->last_shift = now;
+        apply = 1;
+    }
+    auto_repeat->last_event = now;
+    return apply;
+}
+
+
+/*!
+    @brief Считает, сколько сдвигов автоповтора накопилось к текущему моменту
+
+    @param auto_repeat Состояние автоповтора
+    @param now Текущее время, мс
+
+    @return int - количество сдвигов
+
+     tetris.c auto_repeat_update
+*/
+
+int auto_repeat_update(AutoRepeat *auto_repeat, long now){
+    if(!auto_repeat->key){
+        return 0;
+    }
+    if(now - auto_repeat->last_event > INPUT_RELEASE_TIMEOUT){
+        auto_repeat->key = 0;
+        return 0;
+    }
+    if(!auto_repeat->repeating){
+        return 0;
+    }
+    if(arr_time <= 0){
+        auto_repeat->last_shift = now;
+        return MAX_HEIGHT;
+    }
+
+    int shifts = (now - auto_repeat->last_shift) / arr_time;
+    auto_repeat->last_shift += (long)shifts * arr_time;
+    return shifts;
+}
+
+
+/*!
+    @brief Считает, через сколько миллисекунд автоповтору понадобится следующий шаг
+
+    @param auto_repeat Состояние автоповтора
+    @param now Текущее время, мс
+
+    @return long - время до следующего сдвига или отпускания клавиши, -1 если клавиша не удерживается
+
+     tetris.c auto_repeat_wait
+*/
+
+long auto_repeat_wait(AutoRepeat *auto_repeat, long now){
+    if(!auto_repeat->key){
+        return -1;
+    }
+    long wait_time = auto_repeat->last_event + INPUT_RELEASE_TIMEOUT + 1 - now;
+    if(auto_repeat->repeating && auto_repeat->last_shift + arr_time - now < wait_time){
+        wait_time = auto_repeat->last_shift + arr_time - now;
+    }
+    return wait_time > 0 ? wait_time : 0;
+}
+
+
 //LCOV_EXCL_START
 
+#ifndef HEADLESS
+
+/*!
+    @brief Применяет ввод и добавляет его в запись игры
+
+    В запись попадают только применённые клавиши, поэтому повторная симуляция не зависит от автоповтора.
+
+     tetris.c apply_input
+*/
+
+static void apply_input(int input, Shape *current_shape, Board *Table, int *pause_flag, Shape *next_shape, int *flag_generated_next_shape, int *check_for_manual_exit){
+    replay_record('k', input, 0);
+    parse_input(input, current_shape, Table, pause_flag, next_shape, flag_generated_next_shape, check_for_manual_exit);
+}
 
 /*!
     @brief Главный цикл игры. 
@@ -473,44 +985,14 @@ void parse_input(int input, Shape *current_shape, char** Table, int *pause_flag,
 
 int main_loop(WINDOW *game_status_window, WINDOW *gamefield, WINDOW *score) {
 
-    char** Table;
-    Table = (char**)calloc(MAX_HEIGHT, sizeof(char*));
-    for(int i = 0; i < MAX_HEIGHT; i++){
-        Table[i] = (char*)calloc(MAX_WIDTH, sizeof(char));
-    }
-
-    Shape ShapesArr[7] = {{0, 0, 2, (char *[]){(char []){1,1},
-                                              (char []){1,1}}, 1},
-
-                          {0, 0, 3, (char*[]){(char[]){1,1,0}, 
-                                              (char[]){0,1,1}, 
-                                              (char[]){0,0,0}}, 2},
-
-                          {0, 0, 3, (char*[]){(char[]){0,1,0},
-                                              (char[]){1,1,1},
-                                              (char[]){0,0,0}}, 3},
-
-                          {0, 0, 3, (char*[]){(char[]){0,1,1}, 
-                                              (char[]){1,1,0}, 
-                                              (char[]){0,0,0}}, 4},
-
-                          {0, 0, 3, (char*[]){(char[]){1,0,0}, 
-                                              (char[]){1,1,1}, 
-                                              (char[]){0,0,0}}, 5},
-
-                          {0, 0, 3, (char*[]){(char[]){0,0,1}, 
-                                              (char[]){1,1,1}, 
-                                              (char[]){0,0,0}}, 6},
+    Board *Table = create_table();
+    Board *buffer = create_table();
 
-                          {0, 0, 4, (char*[]){(char[]){1,1,1,1},
-                                              (char[]){0,0,0,0}, 
-                                              (char[]){0,0,0,0},
-                                              (char[]){0,0,0,0}}}, 7};
-                                              
-                                              
-    Shape current_shape = ShapesArr[rand() % 7];
+    Shape current_shape = SHAPES[rand() % shapes_count];
     
-    current_shape.x = rand() & (MAX_WIDTH - current_shape.width);
+    current_shape.x = rand() & (board_width - current_shape.width);
+    replay_start();
+    replay_record('s', current_shape.color - 1, current_shape.x);
     Shape next_shape;
     int flag_generated_next_shape = 0;
 
@@ -530,43 +1012,105 @@ int main_loop(WINDOW *game_status_window, WINDOW *gamefield, WINDOW *score) {
     int speed = 1;
     double gradual_piece_speed = 15.0;
     gettimeofday(&start_time, NULL);
+    struct timeval game_start_time = start_time;
+    AutoRepeat auto_repeat = {0};
+    telemetry_start();
+    shm_export_start();
 
     while(!check_for_lose(Table) && !check_for_manual_exit){
         
-        get_next_shape(ShapesArr, &next_shape, &flag_generated_next_shape);
+        if(!flag_generated_next_shape){
+            get_next_shape(SHAPES, &next_shape, &flag_generated_next_shape);
+            replay_record('s', next_shape.color - 1, next_shape.x);
+        }
 
-        char **buffer = create_and_fill_buffer(current_shape, Table);
+        create_and_fill_buffer(current_shape, Table, buffer);
         print_table(gamefield, current_shape, Table, score, game_status_window, score_counter, next_shape, pause_flag, buffer, speed, level);
-        clear_table_memory(buffer);
-
-        int input = getch();
-        parse_input(input, &current_shape, Table, &pause_flag, &next_shape, &flag_generated_next_shape, &check_for_manual_exit);
 
+        //Ждём ввода не дольше, чем до следующего шага падения фигуры или автоповтора. На паузе ждём только ввода
         gettimeofday(&end_time, NULL);
         level_speed_diff = timer - (double)level * 70 - gradual_piece_speed;
+        long wait_time = (long)level_speed_diff - elapsed_ms(start_time, end_time) + 1;
+        long repeat_wait_time = auto_repeat_wait(&auto_repeat, elapsed_ms(game_start_time, end_time));
+        if(repeat_wait_time >= 0 && repeat_wait_time < wait_time){
+            wait_time = repeat_wait_time;
+        }
+        timeout(pause_flag == 1 ? (wait_time > 0 ? (int)wait_time : 0) : -1);
+
+        //Забираем весь накопившийся ввод. Повторы стрелок, присланные терминалом, только продлевают удержание
+        Shape placed_shape = current_shape;
+        int had_next_shape = flag_generated_next_shape;
+        for(int input = getch(); input != ERR; input = getch()){
+            timeout(0);
+            if(input == KEY_RESIZE){
+                layout_game(gamefield, game_status_window, score);
+                continue;
+            }
+            telemetry_record(TELEMETRY_INPUT, input, 0);
 
-        if(end_time.tv_sec * 1000 + end_time.tv_usec / 1000 - start_time.tv_sec * 1000 - start_time.tv_usec / 1000 > level_speed_diff && pause_flag == 1){
+            gettimeofday(&end_time, NULL);
+            placed_shape = current_shape;
+            if(!is_repeatable_input(input) || auto_repeat_press(&auto_repeat, input, elapsed_ms(game_start_time, end_time))){
+                apply_input(input, &current_shape, Table, &pause_flag, &next_shape, &flag_generated_next_shape, &check_for_manual_exit);
+            }
+            //После жёсткого падения сначала нужна новая следующая фигура
+            if(!flag_generated_next_shape || check_for_manual_exit){
+                break;
+            }
+        }
+
+        gettimeofday(&end_time, NULL);
+        if(pause_flag == 1 && flag_generated_next_shape){
+            int shifts = auto_repeat_update(&auto_repeat, elapsed_ms(game_start_time, end_time));
+            for(int i = 0; i < shifts; i++){
+                Shape moved_shape = current_shape;
+                apply_input(auto_repeat.key, &current_shape, Table, &pause_flag, &next_shape, &flag_generated_next_shape, &check_for_manual_exit);
+                if(moved_shape.x == current_shape.x && moved_shape.y == current_shape.y){
+                    break;
+                }
+            }
+        }
+
+        if(had_next_shape && !flag_generated_next_shape){
+            telemetry_record(TELEMETRY_PIECE_PLACED, placed_shape.color, placed_shape.y);
+            gradual_piece_speed = 15.0;
+            gettimeofday(&start_time, NULL);
+        }
+
+        if(elapsed_ms(start_time, end_time) > level_speed_diff && pause_flag == 1 && flag_generated_next_shape){
             gettimeofday(&start_time, NULL); 
-            if(check_if_touches_another_shape(current_shape, Table)){
-                write_shape_to_table(current_shape, Table);
-                current_shape = next_shape;
-                flag_generated_next_shape = 0;
+            placed_shape = current_shape;
+            replay_record('g', 0, 0);
+            if(gravity_step(&current_shape, next_shape, Table, &flag_generated_next_shape)){
+                telemetry_record(TELEMETRY_PIECE_PLACED, placed_shape.color, placed_shape.y);
                 gradual_piece_speed = 15.0;
             }
-            move_shape(&current_shape, 'd', Table);
             gradual_piece_speed += 15.0;
             
         }
         
-        check_for_full_line(Table, &score_counter, &level, &speed);
-        
+        int old_level = level;
+        int lines = check_for_full_line(Table, &score_counter, &level, &speed);
+        if(lines){
+            telemetry_record(TELEMETRY_LINES_CLEARED, lines, score_counter);
+        }
+        if(level != old_level){
+            telemetry_record(TELEMETRY_LEVEL_UP, level, score_counter);
+        }
+        shm_export_publish(Table, current_shape, next_shape, score_counter, level, speed, pause_flag);
         
     }
 
+    shm_export_stop();
+    telemetry_stop(score_counter);
+    replay_stop(score_counter);
     clear_table_memory(Table);
+    clear_table_memory(buffer);
     update_highscore(score_counter);
     return 0;
     
 }
 
+#endif
+
 //LCOV_EXCL_STOP
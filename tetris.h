@@ -4,9 +4,38 @@
 #include <stdlib.h>
 #include <ncurses.h>
 #include <sys/time.h>
+#include <pthread.h>
+#include <stdatomic.h>
 
 #define MAX_HEIGHT 20 ///<Константа, определяющая высоту игрового поля
-#define MAX_WIDTH 14 ///<Константа, определяющая ширину игрового поля
+#define MAX_WIDTH 14 ///<Ширина игрового поля по умолчанию
+#define MIN_BOARD_WIDTH MAX_SHAPE_WIDTH ///<Минимальная ширина игрового поля
+#define MAX_BOARD_WIDTH 32 ///<Максимальная ширина игрового поля, размер массивов под строку поля
+#define MAX_SHAPE_WIDTH 5 ///<Максимальная ширина фигуры
+#define MAX_SHAPE_CELLS (MAX_SHAPE_WIDTH * MAX_SHAPE_WIDTH) ///<Максимальное количество клеток фигуры
+#define BUILTIN_SHAPES_COUNT 7 ///<Количество встроенных фигур
+#define MAX_SHAPES 32 ///<Максимальное количество фигур в наборе
+#define TELEMETRY_RING_SIZE 4096 ///<Количество событий телеметрии, которые помещаются в кольцо
+#define TELEMETRY_FLUSH_INTERVAL 500 ///<Период записи событий телеметрии на диск, мс
+#define REPLAY_MAX_EVENTS 262144 ///<Максимальное количество событий в записи одной игры
+#define REPLAY_VERSION 3 ///<Версия формата записи игры
+#define BOT_POLICIES_COUNT 5 ///<Количество политик ботов
+#define INPUT_DAS 170 ///<Задержка перед автоповтором стрелок по умолчанию, мс
+#define INPUT_ARR 50 ///<Период автоповтора стрелок по умолчанию, мс
+#define INPUT_RELEASE_TIMEOUT 80 ///<Повторы терминала приходят чаще, более позднее нажатие той же клавиши - новое нажатие, мс
+#define SHARED_STATE_PATH_FORMAT "/dev/shm/c_bricks.%d" ///<Путь к опубликованному состоянию игры, %d - pid игры
+#define SHARED_STATE_MAGIC 0x4b524243 ///<Метка файла состояния, "CBRK"
+#define SHARED_STATE_VERSION 3 ///<Версия раскладки файла состояния
+#define SHARED_STATE_READ_ATTEMPTS 1000 ///<Попыток прочитать снимок, пока игра пишет кадр
+#define SHARED_STATE_RETRY_US 100 ///<Пауза между попытками чтения снимка, мкс
+#define ZOBRIST_SEED 0x63627269636b73ULL ///<Сид ключей Зобриста, одинаковый во всех запусках
+#define TRANSPOSITION_BUCKET_SIZE 2 ///<Записей в корзине таблицы транспозиций: по глубине и всегда заменяемая
+#define VERSUS_PLAYERS 2 ///<Количество игроков в режиме против
+#define VERSUS_TICK_MS 16 ///<Длительность тика режима против и бюджет одного кадра, мс
+#define VERSUS_MAX_CATCHUP 4 ///<Сколько пропущенных тиков планировщик догоняет за один кадр
+#define VERSUS_BOT_ACTION_TICKS 6 ///<Бот режима против делает одно действие раз в столько тиков
+#define VERSUS_INPUT_QUEUE_SIZE 32 ///<Размер очереди ввода одного игрока
+#define VERSUS_STATUS_WIDTH 16 ///<Ширина окна статуса между полями
 
 /*!
     Структура, определяющая фигуру
@@ -15,36 +44,406 @@ typedef struct shape{
     int x; ///<Координата фигуры по x от левой верхней границы
     int y; ///<Координата фигуры по y от левой верхней границы
     int width; ///<Ширина фигуры
-    char **shape_array; ///<Массив, в которой записана фигура
-    int color; ///<Цвет фигуры
+    char shape_array[MAX_SHAPE_WIDTH][MAX_SHAPE_WIDTH]; ///<Массив, в которой записана фигура
+    int color; ///<Цвет фигуры, на единицу больше её индекса в наборе фигур
+    int rotation; ///<Номер поворота фигуры, 0..3
 }Shape;
 
+/*!
+    Структура, определяющая игровое поле
+
+    Строки имеют длину MAX_BOARD_WIDTH, клетки правее board_width всегда пустые,
+    поэтому поле можно копировать и сдвигать целыми строками.
+*/
+typedef struct board{
+    char cells[MAX_HEIGHT][MAX_BOARD_WIDTH]; ///<Клетки поля, 1 - занята
+    unsigned long long hash; ///<Хеш Зобриста занятых клеток, см. zobrist.c
+}Board;
+
+/*!
+    Структура, определяющая поворот фигуры, подготовленный при загрузке набора фигур
+
+    Горячие функции движка перебирают только занятые клетки или профили поворота и сравнивают
+    с границами поля крайние клетки, поэтому их стоимость не зависит от ширины фигуры.
+*/
+typedef struct piece_orientation{
+    char cells[MAX_SHAPE_WIDTH][MAX_SHAPE_WIDTH]; ///<Клетки поворота, как в Shape.shape_array
+    unsigned mask; ///<Битовая маска клеток, бит i * MAX_SHAPE_WIDTH + j - клетка [i][j]
+    unsigned char rows[MAX_SHAPE_WIDTH]; ///<Битовые маски строк, бит j - столбец j
+    int count; ///<Количество занятых клеток
+    signed char cell_rows[MAX_SHAPE_CELLS]; ///<Строки занятых клеток
+    signed char cell_columns[MAX_SHAPE_CELLS]; ///<Столбцы занятых клеток
+    signed char bottom[MAX_SHAPE_WIDTH]; ///<Нижняя занятая строка каждого столбца или -1
+    signed char left[MAX_SHAPE_WIDTH]; ///<Левый занятый столбец каждой строки или -1
+    signed char right[MAX_SHAPE_WIDTH]; ///<Правый занятый столбец каждой строки или -1
+    int solid_rows; ///<1 если в каждой строке занятые клетки идут подряд, иначе 0
+    int top; ///<Верхняя занятая строка
+    int lowest; ///<Нижняя занятая строка
+    int leftmost; ///<Левый занятый столбец
+    int rightmost; ///<Правый занятый столбец
+    int canonical; ///<Наименьший номер поворота с теми же клетками
+}PieceOrientation;
+
+/*!
+    Типы событий телеметрии
+*/
+typedef enum telemetry_event_type{
+    TELEMETRY_PIECE_PLACED, ///<Фигура записана в поле. value - цвет фигуры, extra - строка
+    TELEMETRY_INPUT, ///<Нажата клавиша. value - код клавиши
+    TELEMETRY_LINES_CLEARED, ///<Убраны линии. value - количество линий, extra - очки после начисления
+    TELEMETRY_LEVEL_UP, ///<Повышен уровень. value - новый уровень, extra - очки
+    TELEMETRY_GAME_OVER ///<Игра окончена. extra - итоговые очки
+}TelemetryEventType;
+
+/*!
+    Структура, определяющая событие телеметрии
+*/
+typedef struct telemetry_event{
+    long time; ///<Время от начала сессии, мс
+    int type; ///<Тип события
+    int value; ///<Основное значение события
+    int extra; ///<Дополнительное значение события
+}TelemetryEvent;
+
+extern Shape SHAPES[MAX_SHAPES];
+extern char shape_letters[MAX_SHAPES + 1];
+extern int shapes_count;
+extern PieceOrientation piece_orientations[MAX_SHAPES][4];
+extern int board_width;
+
+/*!
+    Структура, определяющая событие записи игры
+*/
+typedef struct replay_event{
+    long time; ///<Время от начала игры, мс
+    char type; ///<Тип события: 's' - появление фигуры, 'k' - ввод, 'g' - шаг падения, 'e' - конец игры
+    int a; ///<Первый аргумент события
+    int b; ///<Второй аргумент события
+}ReplayEvent;
+
+/*!
+    Структура, определяющая статистику повторно проигранной игры
+*/
+typedef struct replay_stats{
+    int recorded_score; ///<Очки, сохранённые в записи
+    int score; ///<Очки, полученные при повторной симуляции
+    int level; ///<Итоговый уровень
+    int pieces; ///<Количество записанных в поле фигур
+    int clears[MAX_SHAPE_WIDTH + 1]; ///<Количество очисток по числу одновременно убранных линий
+    long stack_height_sum; ///<Сумма высот занятой части поля после каждой фигуры
+    long duration; ///<Длительность игры, мс
+    int lost; ///<1 если игра закончилась проигрышем
+}ReplayStats;
+
+
+/*!
+    Структура, определяющая задачу пула потоков
+*/
+typedef struct task{
+    void (*function)(void *arg); ///<Функция задачи
+    void *arg; ///<Аргумент функции
+}Task;
+
+/*!
+    Структура, определяющая очередь задач одного потока
+*/
+typedef struct task_queue{
+    pthread_mutex_t mutex; ///<Защищает очередь от перехвата задач другими потоками
+    Task *tasks; ///<Массив задач
+    int head; ///<Индекс первой задачи, отсюда задачи перехватываются
+    int tail; ///<Индекс после последней задачи, отсюда задачи берёт сам поток
+    int capacity; ///<Размер массива задач
+}TaskQueue;
+
+/*!
+    Структура, определяющая рабочий поток
+*/
+typedef struct worker{
+    pthread_t thread; ///<Поток
+    struct thread_pool *pool; ///<Пул, которому принадлежит поток
+    int index; ///<Номер потока и его очереди
+}Worker;
+
+/*!
+    Структура, определяющая пул потоков с перехватом задач
+*/
+typedef struct thread_pool{
+    int size; ///<Количество потоков
+    TaskQueue *queues; ///<Очереди задач, по одной на поток
+    Worker *workers; ///<Потоки
+    pthread_mutex_t mutex; ///<Защищает счётчики ниже
+    pthread_cond_t available; ///<Сигнал о новых задачах
+    pthread_cond_t done; ///<Сигнал о выполнении всех задач
+    unsigned next_queue; ///<Очередь, в которую попадёт следующая задача
+    long queued; ///<Количество добавленных задач
+    long taken; ///<Количество пробуждений потоков, потраченных на поиск задач
+    long pending; ///<Количество невыполненных задач
+    int stop; ///<Флаг остановки потоков
+}ThreadPool;
+
+
+/*!
+    Структура, определяющая запись таблицы транспозиций
+
+    Запись читается и пишется без блокировок. В check хранится ключ, сложенный по xor со значением
+    и глубиной, поэтому запись, прочитанная во время чужой записи, не совпадёт с ключом.
+*/
+typedef struct transposition_entry{
+    atomic_ullong check; ///<Ключ ^ значение ^ глубина
+    atomic_ullong value; ///<Сохранённое значение
+    atomic_int depth; ///<Глубина, по которой выбирается запись для замены
+}TranspositionEntry;
+
+/*!
+    Структура, определяющая таблицу транспозиций фиксированного размера
+*/
+typedef struct transposition_table{
+    TranspositionEntry *entries; ///<Корзины по TRANSPOSITION_BUCKET_SIZE записей
+    unsigned long mask; ///<Количество корзин минус один
+    atomic_ulong probes; ///<Количество поисков
+    atomic_ulong hits; ///<Количество найденных позиций
+    atomic_ulong stores; ///<Количество записей
+    atomic_ulong replacements; ///<Количество записей поверх другой позиции
+}TranspositionTable;
+
+
+/*!
+    Структура, определяющая политику бота - веса признаков поля
+*/
+typedef struct bot_policy{
+    const char *name; ///<Имя политики
+    double height_weight; ///<Вес суммы высот столбцов
+    double lines_weight; ///<Вес убранных линий
+    double holes_weight; ///<Вес пустых клеток под занятыми
+    double bumpiness_weight; ///<Вес суммы перепадов высот соседних столбцов
+}BotPolicy;
+
+/*!
+    Структура, определяющая ход бота
+*/
+typedef struct bot_move{
+    int rotations; ///<Количество поворотов фигуры, -1 если хода нет
+    int shift; ///<Количество сдвигов вправо от крайнего левого положения
+    double score; ///<Оценка поля после хода
+}BotMove;
+
+extern const BotPolicy BOT_POLICIES[BOT_POLICIES_COUNT];
+
+
+/*!
+    Структура, определяющая состояние автоповтора стрелок
+*/
+typedef struct auto_repeat{
+    int key; ///<Удерживаемая клавиша, 0 если ничего не удерживается
+    int repeating; ///<1 если задержка прошла и фигура сдвигается автоповтором
+    long pressed; ///<Время нажатия, мс
+    long last_event; ///<Время последнего повтора от терминала, мс
+    long last_shift; ///<Время последнего сдвига автоповтором, мс
+}AutoRepeat;
+
+
+/*!
+    Структура, определяющая клавиши игрока в режиме против
+*/
+typedef struct versus_keys{
+    int left; ///<Сдвиг влево
+    int right; ///<Сдвиг вправо
+    int down; ///<Шаг вниз
+    int rotate; ///<Поворот
+    int drop; ///<Жёсткое падение
+}VersusKeys;
+
+/*!
+    Структура, определяющая одного игрока режима против
+*/
+typedef struct versus_player{
+    Board *table; ///<Игровое поле
+    Board *scratch; ///<Поле для поиска хода бота
+    Shape current_shape; ///<Текущая фигура
+    Shape next_shape; ///<Следующая фигура
+    int flag_generated_next_shape; ///<Флаг генерации следующей фигуры
+    int score; ///<Очки
+    int level; ///<Уровень
+    int speed; ///<Скорость
+    int lines; ///<Количество убранных линий
+    int pending_garbage; ///<Пришедшие мусорные строки, которые ещё не вставлены в поле
+    int lost; ///<1 если игрок проиграл
+    unsigned piece_seed; ///<Сид последовательности фигур
+    unsigned garbage_seed; ///<Сид дырок в мусорных строках
+    long gravity_elapsed; ///<Время с последнего шага падения, мс
+    double gradual_piece_speed; ///<Ускорение падения текущей фигуры, как в main_loop
+    AutoRepeat auto_repeat; ///<Автоповтор стрелок
+    const VersusKeys *keys; ///<Клавиши игрока или NULL для бота
+    int inputs[VERSUS_INPUT_QUEUE_SIZE]; ///<Ввод, пришедший до следующего тика, в клавишах parse_input
+    int inputs_count; ///<Количество клавиш в очереди
+    const BotPolicy *bot; ///<Политика бота или NULL для человека
+    BotMove bot_move; ///<Ход бота для текущей фигуры
+    int bot_step; ///<Номер следующего действия хода бота, -1 если ход не выбран
+    int bot_wait; ///<Тиков до следующего действия бота
+}VersusPlayer;
+
+/*!
+    Структура, определяющая игру двух игроков на одном планировщике
+*/
+typedef struct versus_game{
+    VersusPlayer players[VERSUS_PLAYERS]; ///<Игроки, 0 - левое поле
+    long tick; ///<Номер следующего тика
+    int pause_flag; ///<Флаг паузы, общий для обоих полей
+    int check_for_manual_exit; ///<1 если игру прервали клавишей q
+    int over; ///<1 если хотя бы один игрок проиграл
+}VersusGame;
+
+/*!
+    Структура, определяющая окна режима против
+*/
+typedef struct versus_windows{
+    WINDOW *fields[VERSUS_PLAYERS]; ///<Поля игроков
+    WINDOW *status; ///<Окно статуса обоих игроков между полями
+}VersusWindows;
+
+
+/*!
+    Структура, определяющая опубликованное состояние игры. Раскладка файла в /dev/shm
+*/
+typedef struct shared_state{
+    unsigned magic; ///<SHARED_STATE_MAGIC
+    unsigned version; ///<SHARED_STATE_VERSION
+    atomic_uint sequence; ///<Номер seqlock. Нечётный, пока игра пишет кадр
+    int width; ///<Ширина поля
+    int height; ///<Высота поля
+    unsigned long frame; ///<Номер опубликованного тика
+    int score; ///<Очки
+    int level; ///<Уровень
+    int speed; ///<Скорость
+    int paused; ///<1 если игра на паузе
+    int finished; ///<1 если игра окончена
+    Shape current_shape; ///<Текущая фигура
+    Shape next_shape; ///<Следующая фигура
+    char board[MAX_HEIGHT][MAX_BOARD_WIDTH]; ///<Игровое поле без текущей фигуры
+}SharedState;
+
+
 
 //CLI LOGIC
 int handle_menu_option(int choice);
 void game_cli();
+void versus_cli();
+void layout_game(WINDOW *gamefield, WINDOW *game_status_window, WINDOW *score);
 
 //GAME LOGIC
 int main_loop(WINDOW *game_status_window, WINDOW *gamefield, WINDOW *score);
 void print_new_shape(WINDOW *game_status_window, Shape *shape);
-void check_for_full_line(char **table, int *score, int *level, int *speed);
-void clear_line(char **table, int line_number);
-void write_shape_to_table(Shape shape, char** table);
-void move_shape(Shape *shape, char direction, char** Table);
-int check_if_touches_right_border(Shape shape, char** table);
-int check_if_touches_left_border(Shape shape, char** table);
-int check_if_touches_another_shape(Shape shape, char** table);
-void rotate_shape(Shape *shape, char **table);
-int print_table(WINDOW *gamefield, Shape current_shape, char** table, WINDOW *score, WINDOW *game_status_window, int score_counter, Shape next_shape, int pause_flag, char **buffer, int speed, int level);
-int check_for_lose(char **table);
-char **create_and_fill_buffer(Shape current_shape, char** table);
-void clear_table_memory(char** table);
+int check_for_full_line(Board *table, int *score, int *level, int *speed);
+void clear_line(Board *table, int line_number);
+void move_lines_down(Board *table, int line_number);
+void write_shape_to_table(Shape shape, Board *table);
+void move_shape(Shape *shape, char direction, Board *Table);
+int check_if_touches_right_border(Shape shape, Board *table);
+int check_if_touches_left_border(Shape shape, Board *table);
+int check_if_touches_another_shape(Shape shape, Board *table);
+void rotate_shape(Shape *shape, Board *table);
+int check_nonvalid_rotation(Shape shape, Board *table);
+int check_colored_intersection(Shape shape, Shape land_shape, Board *buffer);
+int set_board_width(int width);
+void engine_init();
+int print_table(WINDOW *gamefield, Shape current_shape, Board *table, WINDOW *score, WINDOW *game_status_window, int score_counter, Shape next_shape, int pause_flag, Board *buffer, int speed, int level);
+int check_for_lose(Board *table);
+void create_and_fill_buffer(Shape current_shape, Board *table, Board *buffer);
+Board *create_table();
+void clear_table_memory(Board *table);
+int gravity_step(Shape *current_shape, Shape next_shape, Board *table, int *flag_generated_next_shape);
+int stack_height(Board *table);
+void get_next_shape(const Shape ShapesArr[], Shape *next_shape, int *flag_generated_next_shape);
+void input_configure(int das, int arr);
+int is_repeatable_input(int input);
+int auto_repeat_press(AutoRepeat *auto_repeat, int input, long now);
+int auto_repeat_update(AutoRepeat *auto_repeat, long now);
+long auto_repeat_wait(AutoRepeat *auto_repeat, long now);
+void parse_input(int input, Shape *current_shape, Board *Table, int *pause_flag, Shape *next_shape, int *flag_generated_next_shape, int *check_for_manual_exit);
+long elapsed_ms(struct timeval start, struct timeval end);
+void increase_level(int *level, int score, int *speed);
+int define_added_score(int consecutive_lines);
+int insert_garbage_lines(Board *table, int count, int hole);
+Shape next_seeded_shape(unsigned *seed);
 
 //HIGHSCORE LOGIC
 
 void update_highscore(int score);
 int read_highscore();
 
+//TELEMETRY LOGIC
+
+void telemetry_configure(const char *stream, const char *summary);
+void telemetry_start();
+void telemetry_record(int type, int value, int extra);
+void telemetry_stop(int final_score);
+
+//REPLAY LOGIC
+
+void replay_configure(const char *dir);
+void replay_start();
+void replay_record(char type, int a, int b);
+void replay_stop(int final_score);
+int simulate_replay(const char *data, size_t size, ReplayStats *stats);
+
+//SHARED STATE LOGIC
+
+void shm_export_start();
+void shm_export_publish(Board *table, Shape current_shape, Shape next_shape, int score, int level, int speed, int pause_flag);
+void shm_export_stop();
+const SharedState *shared_state_open(const char *path);
+int shared_state_read(const SharedState *shared, SharedState *snapshot);
+void shared_state_close(const SharedState *shared);
+
+//VERSUS LOGIC
+
+void versus_start(VersusGame *game, unsigned seed, const BotPolicy *bots[VERSUS_PLAYERS]);
+void versus_input(VersusGame *game, int input);
+void versus_tick(VersusGame *game);
+void versus_stop(VersusGame *game);
+void versus_windows_create(VersusWindows *windows);
+void versus_layout(VersusWindows *windows);
+void versus_draw(VersusGame *game, VersusWindows *windows);
+void versus_windows_destroy(VersusWindows *windows);
+int versus_loop(const BotPolicy *opponent);
+
+//PIECE SET LOGIC
+
+void compile_piece_set();
+unsigned piece_set_hash();
+int load_piece_set(const char *path);
+
+//ZOBRIST LOGIC
+
+void zobrist_init();
+void table_rehash(Board *table);
+void zobrist_toggle_cell(Board *table, int row, int column);
+void zobrist_xor_rows(Board *table, int first, int last);
+unsigned long long shape_hash(Shape shape);
+unsigned long long position_hash(Board *table, Shape shape);
+TranspositionTable *transposition_create(int bits);
+int transposition_probe(TranspositionTable *table, unsigned long long key, unsigned long long *value);
+void transposition_store(TranspositionTable *table, unsigned long long key, int depth, unsigned long long value);
+void transposition_clear(TranspositionTable *table);
+void transposition_report(TranspositionTable *table, FILE *stream);
+void transposition_destroy(TranspositionTable *table);
+
+//THREAD POOL LOGIC
+
+int thread_pool_default_size();
+ThreadPool *thread_pool_create(int size);
+void thread_pool_submit(ThreadPool *pool, void (*function)(void *arg), void *arg);
+void thread_pool_wait(ThreadPool *pool);
+void thread_pool_destroy(ThreadPool *pool);
+
+//BOT LOGIC
+
+const BotPolicy *find_bot_policy(const char *name);
+double evaluate_table(const BotPolicy *policy, Board *table, int lines);
+void copy_table(Board *destination, Board *source);
+BotMove choose_bot_move(const BotPolicy *policy, Shape shape, Board *table, Board *scratch, TranspositionTable *cache);
+void apply_bot_move(BotMove move, Shape *shape, Board *table);
+
 
 //BLOOP
 
@@ -0,0 +1,260 @@
+/*!
+    @file thread_pool.c
+    @brief Пул потоков с перехватом задач
+
+    У каждого потока своя очередь задач. Поток берёт задачи с конца своей очереди,
+    а когда она пуста - забирает задачи с начала очередей других потоков.
+*/
+
+#include "tetris.h"
+#include <unistd.h>
+
+
+/*!
+    @brief Берёт задачу с конца собственной очереди потока
+
+    @param queue Очередь потока
+    @param[out] task Задача
+
+    @return int - 1 если задача получена, иначе 0
+
+     thread_pool.c pop_task
+*/
+
+static int pop_task(TaskQueue *queue, Task *task){
+    int found = 0;
+    pthread_mutex_lock(&queue->mutex);
+    if(queue->tail > queue->head){
+        *task = queue->tasks[--queue->tail];
+        found = 1;
+    }
+    pthread_mutex_unlock(&queue->mutex);
+    return found;
+}
+
+
+/*!
+    @brief Забирает задачу с начала чужой очереди
+
+    @param queue Очередь другого потока
+    @param[out] task Задача
+
+    @return int - 1 если задача получена, иначе 0
+
+     thread_pool.c steal_task
+*/
+
+static int steal_task(TaskQueue *queue, Task *task){
+    int found = 0;
+    pthread_mutex_lock(&queue->mutex);
+    if(queue->tail > queue->head){
+        *task = queue->tasks[queue->head++];
+        found = 1;
+    }
+    pthread_mutex_unlock(&queue->mutex);
+    return found;
+}
+
+
+/*!
+    @brief Ищет задачу сначала в своей очереди, затем в очередях остальных потоков
+
+    @param pool Пул потоков
+    @param index Номер потока
+    @param[out] task Задача
+
+    @return int - 1 если задача получена, иначе 0
+
+     thread_pool.c find_task
+*/
+
+static int find_task(ThreadPool *pool, int index, Task *task){
+    if(pop_task(&pool->queues[index], task)){
+        return 1;
+    }
+    for(int i = 1; i < pool->size; i++){
+        if(steal_task(&pool->queues[(index + i) % pool->size], task)){
+            return 1;
+        }
+    }
+    return 0;
+}
+
+
+/*!
+    @brief Рабочий поток пула
+
+     thread_pool.c worker_loop
+*/
+
+static void *worker_loop(void *arg){
+    Worker *worker = (Worker*)arg;
+    ThreadPool *pool = worker->pool;
+    Task task;
+
+    while(true){
+        if(find_task(pool, worker->index, &task)){
+            task.function(task.arg);
+
+            pthread_mutex_lock(&pool->mutex);
+            if(--pool->pending == 0){
+                pthread_cond_broadcast(&pool->done);
+            }
+            pthread_mutex_unlock(&pool->mutex);
+            continue;
+        }
+
+        pthread_mutex_lock(&pool->mutex);
+        while(pool->queued == pool->taken && !pool->stop){
+            pthread_cond_wait(&pool->available, &pool->mutex);
+        }
+        int stop = pool->stop && pool->queued == pool->taken;
+        if(pool->queued != pool->taken){
+            pool->taken++;
+        }
+        pthread_mutex_unlock(&pool->mutex);
+        if(stop){
+            return NULL;
+        }
+    }
+}
+
+
+/*!
+    @brief Возвращает количество доступных ядер процессора
+
+    @return int - количество ядер, не меньше 1
+
+     thread_pool.c thread_pool_default_size
+*/
+
+int thread_pool_default_size(){
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    return cores > 0 ? (int)cores : 1;
+}
+
+
+/*!
+    @brief Создаёт пул потоков
+
+    @param size Количество потоков. Если не больше 0, берётся количество ядер
+
+    @return ThreadPool* - пул потоков
+
+     thread_pool.c thread_pool_create
+*/
+
+ThreadPool *thread_pool_create(int size){
+    if(size <= 0){
+        size = thread_pool_default_size();
+    }
+
+    ThreadPool *pool = (ThreadPool*)calloc(1, sizeof(ThreadPool));
+    pool->size = size;
+    pool->queues = (TaskQueue*)calloc(size, sizeof(TaskQueue));
+    pool->workers = (Worker*)calloc(size, sizeof(Worker));
+    pthread_mutex_init(&pool->mutex, NULL);
+    pthread_cond_init(&pool->available, NULL);
+    pthread_cond_init(&pool->done, NULL);
+
+    for(int i = 0; i < size; i++){
+        pthread_mutex_init(&pool->queues[i].mutex, NULL);
+        pool->workers[i].pool = pool;
+        pool->workers[i].index = i;
+    }
+    for(int i = 0; i < size; i++){
+        pthread_create(&pool->workers[i].thread, NULL, worker_loop, &pool->workers[i]);
+    }
+    return pool;
+}
+
+
+/*!
+    @brief Добавляет задачу в пул
+
+    Задачи распределяются по очередям потоков по кругу, свободные потоки перехватывают их у занятых.
+    @param pool Пул потоков
+    @param function Функция задачи
+    @param arg Аргумент функции
+
+     thread_pool.c thread_pool_submit
+*/
+
+void thread_pool_submit(ThreadPool *pool, void (*function)(void *arg), void *arg){
+    pthread_mutex_lock(&pool->mutex);
+    TaskQueue *queue = &pool->queues[pool->next_queue++ % pool->size];
+    pool->pending++;
+    pthread_mutex_unlock(&pool->mutex);
+
+    pthread_mutex_lock(&queue->mutex);
+    if(queue->tail == queue->capacity){
+        //Начало очереди уже разобрано - сдвигаем задачи, прежде чем расширять массив
+        int count = queue->tail - queue->head;
+        if(queue->head > 0){
+            for(int i = 0; i < count; i++){
+                queue->tasks[i] = queue->tasks[queue->head + i];
+            }
+        }else{
+            queue->capacity = queue->capacity ? queue->capacity * 2 : 64;
+            queue->tasks = (Task*)realloc(queue->tasks, queue->capacity * sizeof(Task));
+        }
+        queue->head = 0;
+        queue->tail = count;
+    }
+    queue->tasks[queue->tail].function = function;
+    queue->tasks[queue->tail].arg = arg;
+    queue->tail++;
+    pthread_mutex_unlock(&queue->mutex);
+
+    pthread_mutex_lock(&pool->mutex);
+    pool->queued++;
+    pthread_cond_signal(&pool->available);
+    pthread_mutex_unlock(&pool->mutex);
+}
+
+
+/*!
+    @brief Ожидает выполнения всех добавленных задач
+
+    @param pool Пул потоков
+
+     thread_pool.c thread_pool_wait
+*/
+
+void thread_pool_wait(ThreadPool *pool){
+    pthread_mutex_lock(&pool->mutex);
+    while(pool->pending > 0){
+        pthread_cond_wait(&pool->done, &pool->mutex);
+    }
+    pthread_mutex_unlock(&pool->mutex);
+}
+
+
+/*!
+    @brief Дожидается задач, останавливает потоки и освобождает пул
+
+    @param pool Пул потоков
+
+     thread_pool.c thread_pool_destroy
+*/
+
+void thread_pool_destroy(ThreadPool *pool){
+    thread_pool_wait(pool);
+
+    pthread_mutex_lock(&pool->mutex);
+    pool->stop = 1;
+    pthread_cond_broadcast(&pool->available);
+    pthread_mutex_unlock(&pool->mutex);
+
+    for(int i = 0; i < pool->size; i++){
+        pthread_join(pool->workers[i].thread, NULL);
+        pthread_mutex_destroy(&pool->queues[i].mutex);
+        free(pool->queues[i].tasks);
+    }
+    pthread_mutex_destroy(&pool->mutex);
+    pthread_cond_destroy(&pool->available);
+    pthread_cond_destroy(&pool->done);
+    free(pool->queues);
+    free(pool->workers);
+    free(pool);
+}
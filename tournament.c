@@ -0,0 +1,249 @@
+/*!
+    @file tournament.c
+    @brief Турнир ботов без интерфейса
+
+    Каждая политика играет одни и те же сиды, одна игра - одна задача пула потоков.
+    Игры идут по тем же правилам, что и основной цикл: gravity_step, check_for_full_line,
+    increase_level и check_for_lose.
+
+    С ключом -H оценки позиций всех игр складываются в общую таблицу транспозиций без блокировок.
+
+    Использование: tournament [-n игр] [-p политика,политика] [-s сид] [-m фигур] [-j потоки] [-w ширина] [-H биты_таблицы] [-f файл_фигур]
+*/
+
+#include "tetris.h"
+#include <math.h>
+#include <string.h>
+#include <unistd.h>
+
+/*!
+    Структура, определяющая одну игру турнира
+*/
+typedef struct tournament_game{
+    const BotPolicy *policy; ///<Политика бота
+    unsigned seed; ///<Сид последовательности фигур
+    int max_pieces; ///<Ограничение на количество фигур
+    int score; ///<Итоговые очки
+    int level; ///<Итоговый уровень
+    int pieces; ///<Количество поставленных фигур
+    int lost; ///<1 если игра закончилась проигрышем, 0 если упёрлась в ограничение
+    TranspositionTable *cache; ///<Общая таблица оценок позиций или NULL
+}TournamentGame;
+
+/*!
+    Структура, определяющая итоги политики
+*/
+typedef struct policy_result{
+    const BotPolicy *policy; ///<Политика бота
+    double mean; ///<Средние очки
+    double interval; ///<Половина ширины 95% доверительного интервала для средних очков
+    double pieces; ///<Среднее количество фигур
+    double lost; ///<Доля проигранных игр
+}PolicyResult;
+
+
+/*!
+    @brief Играет одну игру бота
+
+    @param arg Указатель на TournamentGame
+
+     tournament.c play_game
+*/
+
+static void play_game(void *arg){
+    TournamentGame *game = (TournamentGame*)arg;
+    Board *table = create_table();
+    Board *scratch = create_table();
+    unsigned seed = game->seed;
+
+    Shape current_shape = next_seeded_shape(&seed);
+    Shape next_shape = next_seeded_shape(&seed);
+    int flag_generated_next_shape = 1;
+    int score = 0, level = 1, speed = 1, pieces = 0;
+
+    while(!check_for_lose(table) && pieces < game->max_pieces){
+        BotMove move = choose_bot_move(game->policy, current_shape, table, scratch, game->cache);
+        if(move.rotations >= 0){
+            apply_bot_move(move, &current_shape, table);
+        }
+        while(!gravity_step(&current_shape, next_shape, table, &flag_generated_next_shape)){
+        }
+        pieces++;
+        check_for_full_line(table, &score, &level, &speed);
+        next_shape = next_seeded_shape(&seed);
+        flag_generated_next_shape = 1;
+    }
+
+    game->score = score;
+    game->level = level;
+    game->pieces = pieces;
+    game->lost = check_for_lose(table);
+    clear_table_memory(table);
+    clear_table_memory(scratch);
+}
+
+
+static int compare_results(const void *a, const void *b){
+    double difference = ((const PolicyResult*)b)->mean - ((const PolicyResult*)a)->mean;
+    return (difference > 0) - (difference < 0);
+}
+
+
+/*!
+    @brief Считает итоги политики по её играм
+
+    @param games Игры политики
+    @param count Количество игр
+
+    @return PolicyResult - итоги политики
+
+     tournament.c summarize_policy
+*/
+
+static PolicyResult summarize_policy(TournamentGame *games, int count){
+    PolicyResult result = {games[0].policy, 0, 0, 0, 0};
+    for(int i = 0; i < count; i++){
+        result.mean += games[i].score;
+        result.pieces += games[i].pieces;
+        result.lost += games[i].lost;
+    }
+    result.mean /= count;
+    result.pieces /= count;
+    result.lost /= count;
+
+    if(count > 1){
+        double variance = 0;
+        for(int i = 0; i < count; i++){
+            variance += (games[i].score - result.mean) * (games[i].score - result.mean);
+        }
+        variance /= count - 1;
+        result.interval = 1.96 * sqrt(variance / count);
+    }
+    return result;
+}
+
+
+static void print_usage(const char *name){
+    fprintf(stderr, "usage: %s [-n games] [-p policy,policy] [-s seed] [-m max_pieces] [-j threads] [-w width] [-H table_bits] [-f pieces_file]\npolicies:", name);
+    for(int i = 0; i < BOT_POLICIES_COUNT; i++){
+        fprintf(stderr, " %s", BOT_POLICIES[i].name);
+    }
+    fprintf(stderr, "\n");
+}
+
+
+int main(int argc, char **argv){
+    int games_count = 1000;
+    unsigned seed = 1;
+    int max_pieces = 500;
+    int threads = 0;
+    int width = MAX_WIDTH;
+    int table_bits = 0;
+    const char *pieces_path = NULL;
+    const BotPolicy *policies[BOT_POLICIES_COUNT];
+    int policies_count = 0;
+
+    int opt;
+    while((opt = getopt(argc, argv, "n:p:s:m:j:w:H:f:")) != -1){
+        switch(opt){
+            case 'n':
+            games_count = atoi(optarg);
+            break;
+            case 's':
+            seed = strtoul(optarg, NULL, 10);
+            break;
+            case 'm':
+            max_pieces = atoi(optarg);
+            break;
+            case 'j':
+            threads = atoi(optarg);
+            break;
+            case 'w':
+            width = atoi(optarg);
+            break;
+            case 'H':
+            table_bits = atoi(optarg);
+            break;
+            case 'f':
+            pieces_path = optarg;
+            break;
+            case 'p':
+            for(char *name = strtok(optarg, ","); name; name = strtok(NULL, ",")){
+                const BotPolicy *policy = find_bot_policy(name);
+                if(!policy){
+                    fprintf(stderr, "unknown policy: %s\n", name);
+                    print_usage(argv[0]);
+                    return 1;
+                }
+                if(policies_count == BOT_POLICIES_COUNT){
+                    fprintf(stderr, "too many policies, at most %d\n", BOT_POLICIES_COUNT);
+                    print_usage(argv[0]);
+                    return 1;
+                }
+                policies[policies_count++] = policy;
+            }
+            break;
+            default:
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+    if(games_count <= 0 || max_pieces <= 0 || table_bits < 0 || table_bits > 30 || set_board_width(width) != 0){
+        print_usage(argv[0]);
+        return 1;
+    }
+    if(pieces_path && load_piece_set(pieces_path) != 0){
+        return 1;
+    }
+    engine_init();
+    if(!policies_count){
+        for(int i = 0; i < BOT_POLICIES_COUNT; i++){
+            policies[policies_count++] = &BOT_POLICIES[i];
+        }
+    }
+
+    int total = games_count * policies_count;
+    TournamentGame *games = (TournamentGame*)calloc(total, sizeof(TournamentGame));
+    TranspositionTable *cache = table_bits ? transposition_create(table_bits) : NULL;
+    for(int p = 0; p < policies_count; p++){
+        for(int i = 0; i < games_count; i++){
+            TournamentGame *game = &games[p * games_count + i];
+            game->policy = policies[p];
+            game->seed = seed + i;
+            game->max_pieces = max_pieces;
+            game->cache = cache;
+        }
+    }
+
+    struct timeval start_time, end_time;
+    gettimeofday(&start_time, NULL);
+    ThreadPool *pool = thread_pool_create(threads);
+    for(int i = 0; i < total; i++){
+        thread_pool_submit(pool, play_game, &games[i]);
+    }
+    thread_pool_wait(pool);
+    gettimeofday(&end_time, NULL);
+
+    PolicyResult results[BOT_POLICIES_COUNT];
+    for(int p = 0; p < policies_count; p++){
+        results[p] = summarize_policy(&games[p * games_count], games_count);
+    }
+    qsort(results, policies_count, sizeof(PolicyResult), compare_results);
+
+    printf("%-4s %-10s %12s %12s %10s %8s\n", "rank", "policy", "mean score", "95% ci", "pieces", "lost");
+    for(int p = 0; p < policies_count; p++){
+        printf("%-4d %-10s %12.1f %12.1f %10.1f %7.1f%%\n", p + 1, results[p].policy->name, results[p].mean, results[p].interval, results[p].pieces, results[p].lost * 100);
+    }
+
+    long elapsed = elapsed_ms(start_time, end_time);
+    printf("%d games in %ld ms on %d threads, %.0f games/sec\n", total, elapsed, pool->size, elapsed > 0 ? total * 1000.0 / elapsed : (double)total * 1000.0);
+
+    if(cache){
+        transposition_report(cache, stdout);
+        transposition_destroy(cache);
+    }
+
+    thread_pool_destroy(pool);
+    free(games);
+    return 0;
+}
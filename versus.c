@@ -0,0 +1,584 @@
+/*!
+    @file versus.c
+    @brief Режим против: два поля в одном терминале
+
+    Оба поля идут по одному планировщику тиками по VERSUS_TICK_MS. Тик сначала
+    продвигает каждое поле по тем же правилам, что и основной цикл: ввод через parse_input,
+    автоповтор, gravity_step и check_for_full_line. Только после этого игроки обмениваются
+    мусорными строками, поэтому порядок полей внутри тика ни на что не влияет.
+
+    Убранные линии отправляют сопернику мусор: 2 линии - 1 строку, 3 - 2, 4 - 4.
+    Отправленные строки сначала гасят пришедший игроку мусор. Пришедший мусор вставляется
+    в поле, когда фигура игрока записана в поле, одним сдвигом строк insert_garbage_lines.
+
+    Оба игрока получают одну и ту же последовательность фигур и дырок в мусоре.
+    Против человека играет второй человек за той же клавиатурой или бот из bot.c,
+    который выполняет свой ход по одному действию раз в VERSUS_BOT_ACTION_TICKS тиков.
+
+    Отрисовка не выделяет память: клетки фигуры и её тени берутся из масок строк поворота,
+    строка поля выводится одним вызовом, а терминал обновляется одним doupdate на кадр.
+*/
+
+#include "tetris.h"
+#include <string.h>
+
+static const int VERSUS_GARBAGE[MAX_SHAPE_WIDTH + 1] = {0, 0, 1, 2, 4, 5}; ///<Мусорные строки за 0..MAX_SHAPE_WIDTH убранных линий
+
+static const VersusKeys SOLO_KEYS = {KEY_LEFT, KEY_RIGHT, KEY_DOWN, 'r', ' '}; ///<Клавиши одиночной игры, против бота
+static const VersusKeys LEFT_KEYS = {'a', 'd', 's', 'w', ' '}; ///<Клавиши левого игрока, человек против человека
+static const VersusKeys RIGHT_KEYS = {KEY_LEFT, KEY_RIGHT, KEY_DOWN, KEY_UP, '\n'}; ///<Клавиши правого игрока, человек против человека
+
+
+/*!
+    @brief Начинает игру двух игроков
+
+    @param game Игра
+    @param seed Сид последовательностей фигур и мусора, общий для обоих игроков
+    @param bots Политики ботов для каждого игрока, NULL - человек. Если люди оба,
+    левый играет клавишами WASD и пробелом, правый - стрелками и Enter
+
+     versus.c versus_start
+*/
+
+void versus_start(VersusGame *game, unsigned seed, const BotPolicy *bots[VERSUS_PLAYERS]){
+    memset(game, 0, sizeof(*game));
+    game->pause_flag = 1;
+    int humans = (bots[0] == NULL) + (bots[1] == NULL);
+
+    for(int p = 0; p < VERSUS_PLAYERS; p++){
+        VersusPlayer *player = &game->players[p];
+        player->table = create_table();
+        player->scratch = create_table();
+        player->piece_seed = seed;
+        player->garbage_seed = seed ^ 0x9e3779b9u;
+        player->current_shape = next_seeded_shape(&player->piece_seed);
+        player->level = 1;
+        player->speed = 1;
+        player->gradual_piece_speed = 15.0;
+        player->bot = bots[p];
+        player->bot_step = -1;
+        if(!bots[p]){
+            player->keys = humans == 1 ? &SOLO_KEYS : (p == 0 ? &LEFT_KEYS : &RIGHT_KEYS);
+        }
+    }
+}
+
+
+/*!
+    @brief Переводит клавишу игрока в клавишу parse_input
+
+    @param keys Клавиши игрока
+    @param input Ввод с клавиатуры
+
+    @return int - клавиша parse_input или 0, если клавиша не принадлежит игроку
+
+     versus.c translate_input
+*/
+
+static int translate_input(const VersusKeys *keys, int input){
+    if(input == keys->left){
+        return KEY_LEFT;
+    }
+    if(input == keys->right){
+        return KEY_RIGHT;
+    }
+    if(input == keys->down){
+        return KEY_DOWN;
+    }
+    if(input == keys->rotate){
+        return 'r';
+    }
+    if(input == keys->drop){
+        return ' ';
+    }
+    return 0;
+}
+
+
+/*!
+    @brief Принимает ввод с клавиатуры
+
+    Клавиши p и q действуют сразу на всю игру. Клавиши игроков ставятся в очередь
+    и применяются в начале следующего тика, поэтому оба поля видят ввод в один и тот же момент.
+    @param game Игра
+    @param input Ввод с клавиатуры
+
+     versus.c versus_input
+*/
+
+void versus_input(VersusGame *game, int input){
+    if(input == 'p' || input == 'q'){
+        parse_input(input, &game->players[0].current_shape, game->players[0].table, &game->pause_flag,
+            &game->players[0].next_shape, &game->players[0].flag_generated_next_shape, &game->check_for_manual_exit);
+        return;
+    }
+    if(game->pause_flag != 1){
+        return;
+    }
+    for(int p = 0; p < VERSUS_PLAYERS; p++){
+        VersusPlayer *player = &game->players[p];
+        int key = player->keys ? translate_input(player->keys, input) : 0;
+        if(key && player->inputs_count < VERSUS_INPUT_QUEUE_SIZE){
+            player->inputs[player->inputs_count++] = key;
+            return;
+        }
+    }
+}
+
+
+/*!
+    @brief Выбирает следующее действие бота по его ходу
+
+    Ход выполняется так же, как apply_bot_move: повороты, сдвиг до левой границы,
+    сдвиги вправо, но по одной клавише за раз. В конце фигура роняется пробелом.
+    @param player Игрок-бот
+
+    @return int - клавиша parse_input
+
+     versus.c next_bot_action
+*/
+
+static int next_bot_action(VersusPlayer *player){
+    BotMove move = player->bot_move;
+    if(move.rotations < 0){
+        return ' ';
+    }
+    if(player->bot_step < move.rotations){
+        player->bot_step++;
+        return 'r';
+    }
+    if(player->bot_step == move.rotations){
+        if(!check_if_touches_left_border(player->current_shape, player->table)){
+            return KEY_LEFT;
+        }
+        player->bot_step++;
+    }
+    if(player->bot_step <= move.rotations + move.shift){
+        player->bot_step++;
+        return KEY_RIGHT;
+    }
+    return ' ';
+}
+
+
+/*!
+    @brief Продвигает поле игрока на один тик
+
+    @param game Игра
+    @param player Игрок
+    @param now Время тика от начала игры, мс
+
+    @return int - 1 если фигура записана в поле, иначе 0
+
+     versus.c player_tick
+*/
+
+static int player_tick(VersusGame *game, VersusPlayer *player, long now){
+    if(!player->flag_generated_next_shape){
+        player->next_shape = next_seeded_shape(&player->piece_seed);
+        player->flag_generated_next_shape = 1;
+    }
+    int placed = 0;
+
+    //Ввод после жёсткого падения остаётся в очереди до следующего тика
+    int used = 0;
+    while(used < player->inputs_count && player->flag_generated_next_shape){
+        int input = player->inputs[used++];
+        if(!is_repeatable_input(input) || auto_repeat_press(&player->auto_repeat, input, now)){
+            parse_input(input, &player->current_shape, player->table, &game->pause_flag, &player->next_shape, &player->flag_generated_next_shape, &game->check_for_manual_exit);
+        }
+    }
+    memmove(player->inputs, player->inputs + used, (player->inputs_count - used) * sizeof(int));
+    player->inputs_count -= used;
+
+    if(player->flag_generated_next_shape){
+        int shifts = auto_repeat_update(&player->auto_repeat, now);
+        for(int i = 0; i < shifts; i++){
+            Shape moved_shape = player->current_shape;
+            parse_input(player->auto_repeat.key, &player->current_shape, player->table, &game->pause_flag, &player->next_shape, &player->flag_generated_next_shape, &game->check_for_manual_exit);
+            if(moved_shape.x == player->current_shape.x && moved_shape.y == player->current_shape.y){
+                break;
+            }
+        }
+    }
+
+    if(player->bot && player->flag_generated_next_shape){
+        if(player->bot_step < 0){
+            player->bot_move = choose_bot_move(player->bot, player->current_shape, player->table, player->scratch, NULL);
+            player->bot_step = 0;
+            player->bot_wait = VERSUS_BOT_ACTION_TICKS;
+        }
+        if(--player->bot_wait <= 0){
+            parse_input(next_bot_action(player), &player->current_shape, player->table, &game->pause_flag, &player->next_shape, &player->flag_generated_next_shape, &game->check_for_manual_exit);
+            player->bot_wait = VERSUS_BOT_ACTION_TICKS;
+        }
+    }
+
+    if(!player->flag_generated_next_shape){
+        placed = 1;
+    }else{
+        player->gravity_elapsed += VERSUS_TICK_MS;
+        double level_speed_diff = 1000 - (double)player->level * 70 - player->gradual_piece_speed;
+        if(player->gravity_elapsed > level_speed_diff){
+            player->gravity_elapsed = 0;
+            placed = gravity_step(&player->current_shape, player->next_shape, player->table, &player->flag_generated_next_shape);
+            player->gradual_piece_speed += 15.0;
+        }
+    }
+
+    if(placed){
+        player->gravity_elapsed = 0;
+        player->gradual_piece_speed = 15.0;
+        player->bot_step = -1;
+    }
+    return placed;
+}
+
+
+/*!
+    @brief Вставляет пришедший мусор в поле игрока
+
+    Если новая фигура оказалась внутри поднятого поля, она поднимается, пока есть куда.
+    @param player Игрок, чья фигура только что записана в поле
+
+     versus.c receive_garbage
+*/
+
+static void receive_garbage(VersusPlayer *player){
+    int hole = rand_r(&player->garbage_seed) % board_width;
+    if(insert_garbage_lines(player->table, player->pending_garbage, hole)){
+        player->lost = 1;
+    }
+    player->pending_garbage = 0;
+
+    while(!check_nonvalid_rotation(player->current_shape, player->table) && player->current_shape.y > 0){
+        move_shape(&player->current_shape, 'u', player->table);
+    }
+    if(!check_nonvalid_rotation(player->current_shape, player->table)){
+        player->lost = 1;
+    }
+}
+
+
+/*!
+    @brief Продвигает оба поля на один тик
+
+    @param game Игра
+
+     versus.c versus_tick
+*/
+
+void versus_tick(VersusGame *game){
+    if(game->over || game->pause_flag != 1){
+        return;
+    }
+    long now = game->tick * VERSUS_TICK_MS;
+    game->tick++;
+
+    int placed[VERSUS_PLAYERS];
+    int sent[VERSUS_PLAYERS];
+    for(int p = 0; p < VERSUS_PLAYERS; p++){
+        VersusPlayer *player = &game->players[p];
+        placed[p] = player_tick(game, player, now);
+
+        int lines = check_for_full_line(player->table, &player->score, &player->level, &player->speed);
+        player->lines += lines;
+
+        //Отправленный мусор сначала гасит пришедший
+        sent[p] = VERSUS_GARBAGE[lines < MAX_SHAPE_WIDTH ? lines : MAX_SHAPE_WIDTH];
+        int cancelled = sent[p] < player->pending_garbage ? sent[p] : player->pending_garbage;
+        player->pending_garbage -= cancelled;
+        sent[p] -= cancelled;
+    }
+
+    //Мусор приходит только после того, как оба поля закончили тик
+
+    for(int p = 0; p < VERSUS_PLAYERS; p++){
+        VersusPlayer *player = &game->players[p];
+        player->pending_garbage += sent[VERSUS_PLAYERS - 1 - p];
+        if(placed[p] && player->pending_garbage){
+            receive_garbage(player);
+        }
+        if(check_for_lose(player->table)){
+            player->lost = 1;
+        }
+        game->over |= player->lost;
+    }
+}
+
+
+/*!
+    @brief Освобождает поля игры
+
+    @param game Игра
+
+     versus.c versus_stop
+*/
+
+void versus_stop(VersusGame *game){
+    for(int p = 0; p < VERSUS_PLAYERS; p++){
+        clear_table_memory(game->players[p].table);
+        clear_table_memory(game->players[p].scratch);
+    }
+}
+
+
+//LCOV_EXCL_START
+
+/*!
+    @brief Создаёт окна режима против и цвета, как в game_cli
+
+    @param[out] windows Окна
+
+     versus.c versus_windows_create
+*/
+
+void versus_windows_create(VersusWindows *windows){
+    start_color();
+    init_pair(4, COLOR_CYAN, COLOR_CYAN);
+    init_pair(6, COLOR_YELLOW, COLOR_YELLOW);
+    init_pair(8, COLOR_BLACK, COLOR_BLACK);
+
+    for(int p = 0; p < VERSUS_PLAYERS; p++){
+        windows->fields[p] = newwin(MAX_HEIGHT + 2, (board_width + 1)*2, 0, 0);
+    }
+    windows->status = newwin(MAX_HEIGHT + 2, VERSUS_STATUS_WIDTH, 0, 0);
+    versus_layout(windows);
+}
+
+
+/*!
+    @brief Размещает поля по центру терминала, окно статуса между ними
+
+    Вызывается при старте и при получении KEY_RESIZE.
+    @param windows Окна
+
+     versus.c versus_layout
+*/
+
+void versus_layout(VersusWindows *windows){
+    int field_width = (board_width + 1)*2;
+    int top = (LINES - (MAX_HEIGHT + 2)) / 2;
+    int left = (COLS - 2 * field_width - VERSUS_STATUS_WIDTH) / 2;
+    if(top < 0){
+        top = 0;
+    }
+    if(left < 0){
+        left = 0;
+    }
+
+    mvwin(windows->fields[0], top, left);
+    mvwin(windows->status, top, left + field_width);
+    mvwin(windows->fields[1], top, left + field_width + VERSUS_STATUS_WIDTH);
+    clear();
+    wnoutrefresh(stdscr);
+}
+
+
+/*!
+    @brief Возвращает маску клеток фигуры в строке поля
+
+    @param shape Фигура
+    @param row Строка поля
+
+    @return unsigned long long - бит j установлен, если фигура занимает клетку [row][j]
+
+     versus.c shape_row_mask
+*/
+
+static unsigned long long shape_row_mask(Shape shape, int row){
+    int i = row - shape.y;
+    if(i < 0 || i >= MAX_SHAPE_WIDTH){
+        return 0;
+    }
+    unsigned long long mask = piece_orientations[shape.color - 1][shape.rotation].rows[i];
+    return shape.x >= 0 ? mask << shape.x : mask >> -shape.x;
+}
+
+
+/*!
+    @brief Рисует поле игрока с текущей фигурой и её тенью
+
+    @param field Окно поля
+    @param player Игрок
+
+     versus.c draw_field
+*/
+
+static void draw_field(WINDOW *field, VersusPlayer *player){
+    Shape land_point_shape = player->current_shape;
+    while(!check_if_touches_another_shape(land_point_shape, player->table)){
+        land_point_shape.y++;
+    }
+
+    chtype line[2 * MAX_BOARD_WIDTH];
+    for(int i = 0; i < MAX_HEIGHT; i++){
+        unsigned long long shape_cells = shape_row_mask(player->current_shape, i) | shape_row_mask(land_point_shape, i);
+        for(int j = 0; j < board_width; j++){
+            chtype cell = ' ' | COLOR_PAIR(player->table->cells[i][j] ? 6 : 8);
+            if(shape_cells >> j & 1){
+                cell = ' ' | COLOR_PAIR(4);
+            }
+            line[2 * j] = cell;
+            line[2 * j + 1] = cell;
+        }
+        mvwaddchnstr(field, i + 1, 1, line, 2 * board_width);
+    }
+    box(field, 0, 0);
+    wnoutrefresh(field);
+}
+
+
+/*!
+    @brief Рисует статус игрока: следующую фигуру, очки и мусор
+
+    @param status Окно статуса
+    @param top Первая строка блока игрока
+    @param player Игрок
+    @param number Номер игрока, с единицы
+
+     versus.c draw_player_status
+*/
+
+static void draw_player_status(WINDOW *status, int top, VersusPlayer *player, int number){
+    mvwprintw(status, top, 2, "P%d %.10s", number, player->bot ? player->bot->name : "human");
+
+    Shape *shape = &player->next_shape;
+    int left = 3 + MAX_SHAPE_WIDTH - shape->width;
+    int shape_top = top + 1 + (MAX_SHAPE_WIDTH - shape->width) / 2;
+    for(int i = 0; i < shape->width; i++){
+        for(int j = 0; j < shape->width; j++){
+            if(shape->shape_array[i][j]){
+                mvwaddstr(status, shape_top + i, left + 2 * j, "\u2588\u2588");
+            }
+        }
+    }
+
+    mvwprintw(status, top + 6, 2, "Score: %d", player->score);
+    mvwprintw(status, top + 7, 2, "Level: %d", player->level);
+    mvwprintw(status, top + 8, 2, "Garbage: %d", player->pending_garbage);
+}
+
+
+/*!
+    @brief Рисует кадр режима против
+
+    Окна только помечаются к выводу, терминал обновляется одним doupdate.
+    @param game Игра
+    @param windows Окна
+
+     versus.c versus_draw
+*/
+
+void versus_draw(VersusGame *game, VersusWindows *windows){
+    for(int p = 0; p < VERSUS_PLAYERS; p++){
+        draw_field(windows->fields[p], &game->players[p]);
+    }
+
+    werase(windows->status);
+    box(windows->status, 0, 0);
+    draw_player_status(windows->status, 1, &game->players[0], 1);
+    draw_player_status(windows->status, 11, &game->players[1], 2);
+    if(game->over){
+        int left_lost = game->players[0].lost, right_lost = game->players[1].lost;
+        mvwprintw(windows->status, 10, 2, left_lost && right_lost ? "DRAW" : (left_lost ? "P2 WINS" : "P1 WINS"));
+    }else if(game->pause_flag == -1){
+        mvwprintw(windows->status, 10, 2, "PAUSED");
+    }
+    wnoutrefresh(windows->status);
+    doupdate();
+}
+
+
+/*!
+    @brief Удаляет окна режима против
+
+    @param windows Окна
+
+     versus.c versus_windows_destroy
+*/
+
+void versus_windows_destroy(VersusWindows *windows){
+    for(int p = 0; p < VERSUS_PLAYERS; p++){
+        delwin(windows->fields[p]);
+    }
+    delwin(windows->status);
+}
+
+
+/*!
+    @brief Главный цикл режима против
+
+    Цикл ждёт ввода не дольше, чем до следующего тика, затем выполняет все наступившие тики
+    и рисует один кадр. Если кадр затянулся, планировщик догоняет не больше VERSUS_MAX_CATCHUP
+    тиков, а остальное время пропускает, чтобы оба поля не ускорялись рывком.
+    @param opponent Политика бота правого игрока или NULL для второго человека
+
+    @return int - номер победившего игрока с единицы, 0 при ничьей или выходе
+
+     versus.c versus_loop
+*/
+
+int versus_loop(const BotPolicy *opponent){
+    VersusWindows windows;
+    versus_windows_create(&windows);
+
+    VersusGame game;
+    const BotPolicy *bots[VERSUS_PLAYERS] = {NULL, opponent};
+    versus_start(&game, (unsigned)rand(), bots);
+
+    struct timeval start_time, now;
+    gettimeofday(&start_time, NULL);
+    long next_tick = 0;
+
+    while(!game.over && !game.check_for_manual_exit){
+        versus_draw(&game, &windows);
+        int was_paused = game.pause_flag != 1;
+
+        gettimeofday(&now, NULL);
+        long wait_time = next_tick - elapsed_ms(start_time, now);
+        timeout(game.pause_flag == 1 ? (wait_time > 0 ? (int)wait_time : 0) : -1);
+        for(int input = getch(); input != ERR; input = getch()){
+            timeout(0);
+            if(input == KEY_RESIZE){
+                versus_layout(&windows);
+                continue;
+            }
+            versus_input(&game, input);
+            if(game.pause_flag != 1 || game.check_for_manual_exit){
+                break;
+            }
+        }
+
+        gettimeofday(&now, NULL);
+        long elapsed = elapsed_ms(start_time, now);
+        //После паузы тики отсчитываются заново, пропущенное время не догоняется
+        if(was_paused || game.pause_flag != 1){
+            next_tick = elapsed;
+            continue;
+        }
+        for(int ticks = 0; elapsed >= next_tick && ticks < VERSUS_MAX_CATCHUP; ticks++){
+            versus_tick(&game);
+            next_tick += VERSUS_TICK_MS;
+        }
+        if(elapsed >= next_tick){
+            next_tick = elapsed + VERSUS_TICK_MS;
+        }
+    }
+
+    int winner = 0;
+    if(game.over){
+        winner = game.players[0].lost == game.players[1].lost ? 0 : (game.players[0].lost ? 2 : 1);
+        versus_draw(&game, &windows);
+        timeout(-1);
+        while(getch() == KEY_RESIZE){
+            versus_layout(&windows);
+            versus_draw(&game, &windows);
+        }
+    }
+    versus_stop(&game);
+    versus_windows_destroy(&windows);
+    return winner;
+}
+
+//LCOV_EXCL_STOP
@@ -0,0 +1,184 @@
+/*!
+    @file versus_bench.c
+    @brief Замер кадра режима против
+
+    Два бота играют в режиме против тем же кодом, что и в игре, а кадры рисуются настоящим
+    versus_draw в терминал ncurses, вывод которого уходит в /dev/null. Каждый тик замеряется
+    отдельно: шаг обоих полей и отрисовка кадра вместе с doupdate. Итог сравнивается с бюджетом
+    кадра VERSUS_TICK_MS: программа завершается с кодом 1, если 99-й процентиль кадра в него не укладывается.
+    Когда игра кончается, начинается следующая со следующим сидом.
+
+    Использование: versus_bench [-n тиков] [-p политика,политика] [-s сид] [-w ширина] [-f файл_фигур]
+*/
+
+#include "tetris.h"
+#include <locale.h>
+#include <string.h>
+#include <unistd.h>
+
+
+/*!
+    @brief Считает количество микросекунд между двумя моментами времени
+
+    @param start Начальный момент
+    @param end Конечный момент
+
+    @return long - разница в микросекундах
+
+     versus_bench.c elapsed_us
+*/
+
+static long elapsed_us(struct timeval start, struct timeval end){
+    return (end.tv_sec - start.tv_sec) * 1000000 + (end.tv_usec - start.tv_usec);
+}
+
+
+static int compare_longs(const void *a, const void *b){
+    long difference = *(const long*)a - *(const long*)b;
+    return (difference > 0) - (difference < 0);
+}
+
+
+/*!
+    @brief Печатает среднее, процентили и максимум замеров
+
+    @param name Название замера
+    @param samples Замеры в микросекундах, сортируются
+    @param count Количество замеров
+
+    @return long - 99-й процентиль, мкс
+
+     versus_bench.c report_samples
+*/
+
+static long report_samples(const char *name, long *samples, int count){
+    double sum = 0;
+    for(int i = 0; i < count; i++){
+        sum += samples[i];
+    }
+    qsort(samples, count, sizeof(long), compare_longs);
+    long p99 = samples[count * 99 / 100];
+    printf("%-6s mean %7.1f us, median %6ld us, p99 %6ld us, max %6ld us\n", name, sum / count, samples[count / 2], p99, samples[count - 1]);
+    return p99;
+}
+
+
+static void print_usage(const char *name){
+    fprintf(stderr, "usage: %s [-n ticks] [-p policy,policy] [-s seed] [-w width] [-f pieces_file]\n", name);
+}
+
+
+int main(int argc, char **argv){
+    int ticks = 3600;
+    unsigned seed = 1;
+    int width = MAX_WIDTH;
+    const char *pieces_path = NULL;
+    const BotPolicy *bots[VERSUS_PLAYERS] = {&BOT_POLICIES[0], &BOT_POLICIES[0]};
+
+    int opt;
+    while((opt = getopt(argc, argv, "n:p:s:w:f:")) != -1){
+        switch(opt){
+            case 'n':
+            ticks = atoi(optarg);
+            break;
+            case 's':
+            seed = strtoul(optarg, NULL, 10);
+            break;
+            case 'w':
+            width = atoi(optarg);
+            break;
+            case 'f':
+            pieces_path = optarg;
+            break;
+            case 'p':{
+                int count = 0;
+                for(char *name = strtok(optarg, ","); name; name = strtok(NULL, ",")){
+                    const BotPolicy *policy = find_bot_policy(name);
+                    if(!policy){
+                        fprintf(stderr, "unknown policy: %s\n", name);
+                        return 1;
+                    }
+                    if(count == VERSUS_PLAYERS){
+                        fprintf(stderr, "too many policies, at most %d\n", VERSUS_PLAYERS);
+                        return 1;
+                    }
+                    bots[count++] = policy;
+                }
+                if(count == 1){
+                    bots[1] = bots[0];
+                }
+            }
+            break;
+            default:
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+    if(ticks <= 0 || set_board_width(width) != 0){
+        print_usage(argv[0]);
+        return 1;
+    }
+    if(pieces_path && load_piece_set(pieces_path) != 0){
+        return 1;
+    }
+    engine_init();
+
+    //Терминал без экрана: ncurses делает всю работу по выводу, но байты уходят в /dev/null
+    FILE *output = fopen("/dev/null", "w");
+    FILE *input = fopen("/dev/null", "r");
+    const char *term = getenv("TERM");
+    setlocale(LC_CTYPE, "en_US.UTF-8");
+    SCREEN *screen = newterm(term && *term && strcmp(term, "dumb") != 0 ? term : "xterm-256color", output, input);
+    if(!screen){
+        fprintf(stderr, "cannot create terminal\n");
+        return 1;
+    }
+    resizeterm(MAX_HEIGHT + 4, 4 * (board_width + 1) + VERSUS_STATUS_WIDTH + 4);
+
+    VersusWindows windows;
+    versus_windows_create(&windows);
+    VersusGame game;
+    versus_start(&game, seed, bots);
+
+    long *tick_samples = (long*)malloc(ticks * sizeof(long));
+    long *frame_samples = (long*)malloc(ticks * sizeof(long));
+    int games = 1, pieces = 0, over_budget = 0;
+    for(int i = 0; i < ticks; i++){
+        if(game.over){
+            versus_stop(&game);
+            versus_start(&game, ++seed, bots);
+            games++;
+        }
+
+        struct timeval start_time, tick_time, end_time;
+        gettimeofday(&start_time, NULL);
+        versus_tick(&game);
+        gettimeofday(&tick_time, NULL);
+        versus_draw(&game, &windows);
+        gettimeofday(&end_time, NULL);
+
+        tick_samples[i] = elapsed_us(start_time, tick_time);
+        frame_samples[i] = elapsed_us(start_time, end_time);
+        if(frame_samples[i] > VERSUS_TICK_MS * 1000){
+            over_budget++;
+        }
+        for(int p = 0; p < VERSUS_PLAYERS; p++){
+            pieces += !game.players[p].flag_generated_next_shape;
+        }
+    }
+
+    versus_stop(&game);
+    versus_windows_destroy(&windows);
+    endwin();
+    delscreen(screen);
+    fclose(output);
+    fclose(input);
+
+    printf("%d ticks, %d games, %d pieces, board %dx%d, %s vs %s\n", ticks, games, pieces, board_width, MAX_HEIGHT, bots[0]->name, bots[1]->name);
+    report_samples("tick", tick_samples, ticks);
+    long p99 = report_samples("frame", frame_samples, ticks);
+    printf("budget %d ms: p99 frame uses %.1f%%, %d frames over budget\n", VERSUS_TICK_MS, p99 / (VERSUS_TICK_MS * 10.0), over_budget);
+    free(tick_samples);
+    free(frame_samples);
+    return p99 > VERSUS_TICK_MS * 1000;
+}
@@ -0,0 +1,339 @@
+/*!
+    @file zobrist.c
+    @brief Хеши Зобриста и таблица транспозиций
+
+    Хеш поля - xor ключей всех занятых клеток. Он хранится вместе с клетками в структуре Board.
+    write_shape_to_table и удаление линий обновляют хеш по изменённым клеткам,
+    код, который пишет клетки поля напрямую, вызывает table_rehash.
+
+    Хеш фигуры - xor ключей её клеток в отдельной плоскости для каждой фигуры, поэтому
+    он зависит от фигуры, её поворота и положения, а симметричные повороты совпадают.
+*/
+
+#include "tetris.h"
+#include <string.h>
+
+static unsigned long long cell_keys[MAX_HEIGHT][MAX_BOARD_WIDTH]; ///<Ключи занятых клеток поля
+static unsigned long long piece_keys[MAX_SHAPES][MAX_HEIGHT][MAX_BOARD_WIDTH]; ///<Ключи клеток текущей фигуры
+
+
+/*!
+    @brief Генератор splitmix64
+
+    @param state Указатель на состояние генератора
+
+    @return unsigned long long - следующее случайное число
+
+     zobrist.c splitmix64
+*/
+
+static unsigned long long splitmix64(unsigned long long *state){
+    unsigned long long z = (*state += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+
+/*!
+    @brief Заполняет ключи Зобриста
+
+    Вызывается один раз из engine_init до создания первого поля.
+
+     zobrist.c zobrist_init
+*/
+
+void zobrist_init(){
+    unsigned long long state = ZOBRIST_SEED;
+    for(int i = 0; i < MAX_HEIGHT; i++){
+        for(int j = 0; j < MAX_BOARD_WIDTH; j++){
+            cell_keys[i][j] = splitmix64(&state);
+        }
+    }
+    for(int type = 0; type < MAX_SHAPES; type++){
+        for(int i = 0; i < MAX_HEIGHT; i++){
+            for(int j = 0; j < MAX_BOARD_WIDTH; j++){
+                piece_keys[type][i][j] = splitmix64(&state);
+            }
+        }
+    }
+}
+
+
+/*!
+    @brief Пересчитывает хеш поля целиком после прямой записи клеток
+
+    @param table Игровое поле
+
+     zobrist.c table_rehash
+*/
+
+void table_rehash(Board *table){
+    table->hash = 0;
+    zobrist_xor_rows(table, 0, MAX_HEIGHT - 1);
+}
+
+
+/*!
+    @brief Меняет в хеше поля состояние одной клетки
+
+    Вызывается при каждом изменении клетки с пустой на занятую или обратно.
+    @param table Игровое поле
+    @param row Строка клетки
+    @param column Столбец клетки
+
+     zobrist.c zobrist_toggle_cell
+*/
+
+void zobrist_toggle_cell(Board *table, int row, int column){
+    table->hash ^= cell_keys[row][column];
+}
+
+
+/*!
+    @brief Складывает с хешем поля ключи занятых клеток строк
+
+    Перед сдвигом строк вызывается, чтобы убрать их старые клетки из хеша, после сдвига - чтобы добавить новые.
+    @param table Игровое поле
+    @param first Первая строка
+    @param last Последняя строка, включительно
+
+     zobrist.c zobrist_xor_rows
+*/
+
+void zobrist_xor_rows(Board *table, int first, int last){
+    unsigned long long hash = table->hash;
+    for(int i = first; i <= last; i++){
+        for(int j = 0; j < board_width; j++){
+            if(table->cells[i][j]){
+                hash ^= cell_keys[i][j];
+            }
+        }
+    }
+    table->hash = hash;
+}
+
+
+/*!
+    @brief Считает хеш фигуры по её типу, повороту и положению
+
+    @param shape Фигура
+
+    @return unsigned long long - xor ключей клеток фигуры
+
+     zobrist.c shape_hash
+*/
+
+unsigned long long shape_hash(Shape shape){
+    const PieceOrientation *orientation = &piece_orientations[shape.color - 1][shape.rotation];
+    unsigned long long hash = 0;
+    for(int k = 0; k < orientation->count; k++){
+        int row = shape.y + orientation->cell_rows[k], column = shape.x + orientation->cell_columns[k];
+        if(row >= 0 && row < MAX_HEIGHT && column >= 0 && column < MAX_BOARD_WIDTH){
+            hash ^= piece_keys[shape.color - 1][row][column];
+        }
+    }
+    return hash;
+}
+
+
+/*!
+    @brief Считает хеш позиции - поля вместе с текущей фигурой
+
+    @param table Игровое поле
+    @param shape Текущая фигура
+
+    @return unsigned long long - хеш позиции
+
+     zobrist.c position_hash
+*/
+
+unsigned long long position_hash(Board *table, Shape shape){
+    return table->hash ^ shape_hash(shape);
+}
+
+
+/*!
+    @brief Создаёт пустую таблицу транспозиций
+
+    @param bits Логарифм количества корзин
+
+    @return TranspositionTable* - таблица
+
+     zobrist.c transposition_create
+*/
+
+TranspositionTable *transposition_create(int bits){
+    TranspositionTable *table = (TranspositionTable*)calloc(1, sizeof(TranspositionTable));
+    table->mask = (1UL << bits) - 1;
+    table->entries = (TranspositionEntry*)calloc((table->mask + 1) * TRANSPOSITION_BUCKET_SIZE, sizeof(TranspositionEntry));
+    return table;
+}
+
+
+/*!
+    @brief Восстанавливает ключ позиции, записанной в запись
+
+    @param entry Запись
+    @param[out] value Значение записи
+    @param[out] depth Глубина записи
+
+    @return unsigned long long - ключ позиции или 0, если запись пуста
+
+     zobrist.c entry_key
+*/
+
+static unsigned long long entry_key(TranspositionEntry *entry, unsigned long long *value, int *depth){
+    unsigned long long check = atomic_load_explicit(&entry->check, memory_order_relaxed);
+    *value = atomic_load_explicit(&entry->value, memory_order_relaxed);
+    *depth = atomic_load_explicit(&entry->depth, memory_order_relaxed);
+    return check ? check ^ *value ^ (unsigned long long)*depth : 0;
+}
+
+
+/*!
+    @brief Проверяет, что запись хранит позицию с данным ключом, и читает её значение
+
+    @param entry Запись
+    @param key Ключ позиции
+    @param[out] value Значение записи
+
+    @return int - 1 если запись хранит эту позицию, иначе 0
+
+     zobrist.c read_entry
+*/
+
+static int read_entry(TranspositionEntry *entry, unsigned long long key, unsigned long long *value){
+    unsigned long long stored;
+    int depth;
+    if(entry_key(entry, &stored, &depth) != key){
+        return 0;
+    }
+    *value = stored;
+    return 1;
+}
+
+
+static void write_entry(TranspositionEntry *entry, unsigned long long key, int depth, unsigned long long value){
+    atomic_store_explicit(&entry->check, key ^ value ^ (unsigned long long)depth, memory_order_relaxed);
+    atomic_store_explicit(&entry->value, value, memory_order_relaxed);
+    atomic_store_explicit(&entry->depth, depth, memory_order_relaxed);
+}
+
+
+/*!
+    @brief Ищет позицию в таблице транспозиций
+
+    @param table Таблица
+    @param key Ключ позиции
+    @param[out] value Сохранённое значение
+
+    @return int - 1 если позиция найдена, иначе 0
+
+     zobrist.c transposition_probe
+*/
+
+int transposition_probe(TranspositionTable *table, unsigned long long key, unsigned long long *value){
+    //Нулевой ключ совпал бы с пустой записью
+    key = key ? key : 1;
+    TranspositionEntry *bucket = &table->entries[(key & table->mask) * TRANSPOSITION_BUCKET_SIZE];
+    atomic_fetch_add_explicit(&table->probes, 1, memory_order_relaxed);
+    for(int i = 0; i < TRANSPOSITION_BUCKET_SIZE; i++){
+        if(read_entry(&bucket[i], key, value)){
+            atomic_fetch_add_explicit(&table->hits, 1, memory_order_relaxed);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+
+/*!
+    @brief Сохраняет позицию в таблице транспозиций
+
+    Первая запись корзины хранит позицию с наибольшей глубиной: новая позиция с не меньшей
+    глубиной занимает её, а прежняя переходит во вторую запись. Иначе новая позиция
+    записывается во вторую запись, которая заменяется всегда.
+    @param table Таблица
+    @param key Ключ позиции
+    @param depth Глубина - чем больше, тем дороже позицию пересчитать
+    @param value Значение
+
+     zobrist.c transposition_store
+*/
+
+void transposition_store(TranspositionTable *table, unsigned long long key, int depth, unsigned long long value){
+    key = key ? key : 1;
+    TranspositionEntry *bucket = &table->entries[(key & table->mask) * TRANSPOSITION_BUCKET_SIZE];
+    TranspositionEntry *always = &bucket[TRANSPOSITION_BUCKET_SIZE - 1];
+    atomic_fetch_add_explicit(&table->stores, 1, memory_order_relaxed);
+
+    unsigned long long kept_value, evicted_value;
+    int kept_depth, evicted_depth;
+    unsigned long long kept_key = entry_key(&bucket[0], &kept_value, &kept_depth);
+    unsigned long long evicted_key = entry_key(always, &evicted_value, &evicted_depth);
+
+    if(kept_key == key || !kept_key || depth >= kept_depth){
+        if(kept_key && kept_key != key){
+            if(evicted_key && evicted_key != kept_key){
+                atomic_fetch_add_explicit(&table->replacements, 1, memory_order_relaxed);
+            }
+            write_entry(always, kept_key, kept_depth, kept_value);
+        }
+        write_entry(&bucket[0], key, depth, value);
+    }else{
+        if(evicted_key && evicted_key != key){
+            atomic_fetch_add_explicit(&table->replacements, 1, memory_order_relaxed);
+        }
+        write_entry(always, key, depth, value);
+    }
+}
+
+
+/*!
+    @brief Очищает таблицу транспозиций и её статистику
+
+    @param table Таблица
+
+     zobrist.c transposition_clear
+*/
+
+void transposition_clear(TranspositionTable *table){
+    memset(table->entries, 0, (table->mask + 1) * TRANSPOSITION_BUCKET_SIZE * sizeof(TranspositionEntry));
+    atomic_store(&table->probes, 0);
+    atomic_store(&table->hits, 0);
+    atomic_store(&table->stores, 0);
+    atomic_store(&table->replacements, 0);
+}
+
+
+/*!
+    @brief Печатает статистику таблицы транспозиций
+
+    @param table Таблица
+    @param stream Поток вывода
+
+     zobrist.c transposition_report
+*/
+
+void transposition_report(TranspositionTable *table, FILE *stream){
+    unsigned long probes = atomic_load(&table->probes);
+    unsigned long hits = atomic_load(&table->hits);
+    fprintf(stream, "transposition table: %lu entries, %lu probes, %.1f%% hits, %lu stores, %lu replacements\n",
+        (table->mask + 1) * TRANSPOSITION_BUCKET_SIZE, probes, probes ? hits * 100.0 / probes : 0.0,
+        atomic_load(&table->stores), atomic_load(&table->replacements));
+}
+
+
+/*!
+    @brief Освобождает память таблицы транспозиций
+
+    @param table Таблица
+
+     zobrist.c transposition_destroy
+*/
+
+void transposition_destroy(TranspositionTable *table){
+    free(table->entries);
+    free(table);
+}